@@ -0,0 +1,619 @@
+/********************************************************************
+* Microbenchmarks for the hot paths of the probability generator
+*
+* Links against the engine the program runs on, so every function is
+* timed exactly as the program runs it. The corpus is dealt from a
+* seeded generator and holds the same number of hands of each of the
+* nine major ranks, so rare hands such as straight flushes weigh as
+* much as high cards.
+*
+* Every benchmark repeats over the corpus until at least minTime
+* seconds have passed and prints one JSON object per line:
+*   {"benchmark":"evaluateHand","ops":...,"ns_per_op":...,
+*    "per_second":...,"unit":"hands"}
+* "unit" says what per_second counts, so lines of two releases can be
+* compared field by field.
+*
+* Usage: benchmark [--seed N] [--min-time S]
+*
+* benchmark --accuracy [--samples N] [--precision P] [--threads N]
+* [--table FILE] runs the whole corpus once through every way of
+* working out the probabilities instead, see benchAccuracy.
+********************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "poker_engine.h"
+#define HANDS_PER_CATEGORY  64
+#define CORPUS_SIZE         (POKER_STRAIGHT_FLUSH*HANDS_PER_CATEGORY)
+#define DEFAULT_MIN_TIME    0.5
+#define BENCHMARK_SAMPLES   50000
+#define BENCHMARK_DRAW_SAMPLES 10000
+#define BENCHMARK_EQUITY_DEALS 10000
+#define BENCHMARK_SEED      20170302
+#define DEFAULT_ACCURACY_SAMPLES   50000
+#define DEFAULT_ACCURACY_PRECISION 0.5
+#define STRATEGY_COUNT      7
+
+/********************************************************************
+* Strategy is one way of working out the probabilities that
+* benchAccuracy compares: the options it differs in from the defaults
+********************************************************************/
+typedef struct
+{ const char *name;
+  int  mode;
+  int  sampling;
+} Strategy;
+/********************************************************************
+* StrategyRun is what the process running a strategy sends back
+*   status: POKER_OK, or the error that stopped it
+*   probabilities[][]: of every corpus hand, as in PokerResult
+*   draws: mean draws per discard, 0 when nothing was sampled
+********************************************************************/
+typedef struct
+{ int  status;
+  float probabilities[CORPUS_SIZE][POKER_HAND_SIZE];
+  double draws;
+} StrategyRun;
+/*********************************************************************
+*   STRATEGIES[]: every strategy benchAccuracy runs, exact first as it
+*     is the ground truth of the others. Monte Carlo is the fixed
+*     sample method with draws straight out of the deck, sobol the
+*     quasi Monte Carlo one.
+**********************************************************************/
+const Strategy STRATEGIES[STRATEGY_COUNT] =
+{ { "exact", POKER_EXACT_MODE, POKER_RANDOM_SAMPLING },
+  { "monte-carlo", POKER_MONTE_CARLO_MODE, POKER_RANDOM_SAMPLING },
+  { "monte-carlo/stratified", POKER_MONTE_CARLO_MODE, POKER_STRATIFIED_SAMPLING },
+  { "monte-carlo/sobol", POKER_MONTE_CARLO_MODE, POKER_SOBOL_SAMPLING },
+  { "adaptive", POKER_ADAPTIVE_MODE, POKER_RANDOM_SAMPLING },
+  { "adaptive/sobol", POKER_ADAPTIVE_MODE, POKER_SOBOL_SAMPLING },
+  { "table", POKER_TABLE_MODE, POKER_RANDOM_SAMPLING } };
+
+/********************************************************************
+* Benchmark Variables
+*
+*   corpusMasks[]: card masks of the corpus, category by category
+*   corpusHands[]: the same hands as readLine would hold them
+*   corpusSevenMasks[]: every corpus hand with two more random cards
+*   minTime: seconds every benchmark runs for at least
+*   benchmarkSink: results are added here so no call is optimized out
+*   accuracyOptions: the options of --accuracy, the sample count,
+*     precision, threads and table file every strategy shares
+*   accuracyResults[]: results of the strategy a child process runs
+********************************************************************/
+uint64_t corpusMasks[CORPUS_SIZE];
+PokerHand corpusHands[CORPUS_SIZE];
+uint64_t corpusSevenMasks[CORPUS_SIZE];
+double minTime=DEFAULT_MIN_TIME;
+volatile uint64_t benchmarkSink;
+PokerOptions accuracyOptions;
+PokerResult accuracyResults[CORPUS_SIZE];
+
+void buildCorpus(uint64_t seed);
+double now(void);
+void report(const char *name, uint64_t ops, double seconds, double perOp, const char *unit);
+void benchSortHand(void);
+void benchSortHands(void);
+void benchGetHandRank(void);
+void benchIsBetterHand(void);
+void benchRepeatCards(void);
+void benchEvaluateHand(void);
+void benchEvaluateSevenCards(void);
+void benchReferenceHandRank(void);
+void benchProbabilities(const char *name, int mode, int samples, uint64_t seed,
+                        double samplesPerHand);
+void benchEquity(int opponents, uint64_t seed);
+void benchVariant(int variant, uint64_t seed);
+void benchAccuracy(void);
+int  measureStrategy(const Strategy *strategy, StrategyRun *run, double *wallTime,
+                     struct rusage *usage);
+void runStrategy(const Strategy *strategy, StrategyRun *run);
+long inheritedMemory(void);
+
+int main(int argc, char *argv[])
+{ uint64_t seed=BENCHMARK_SEED;
+  int i, error, accuracy=POKER_FALSE;
+  pokerInitOptions(&accuracyOptions);
+  accuracyOptions.sampleNumber=DEFAULT_ACCURACY_SAMPLES;
+  accuracyOptions.precision=DEFAULT_ACCURACY_PRECISION;
+  for(i=1; i<argc; ++i)
+  { if(strcmp(argv[i],"--seed")==0 && i+1<argc) seed=strtoull(argv[++i],NULL,0);
+    else if(strcmp(argv[i],"--min-time")==0 && i+1<argc) minTime=atof(argv[++i]);
+    else if(strcmp(argv[i],"--accuracy")==0) accuracy=POKER_TRUE;
+    else if(strcmp(argv[i],"--samples")==0 && i+1<argc
+            && (accuracyOptions.sampleNumber=atoi(argv[++i]))>0);
+    else if(strcmp(argv[i],"--precision")==0 && i+1<argc
+            && (accuracyOptions.precision=atof(argv[++i]))>0);
+    else if(strcmp(argv[i],"--threads")==0 && i+1<argc
+            && (accuracyOptions.threadCount=atoi(argv[++i]))>=1
+            && accuracyOptions.threadCount<=POKER_MAX_THREADS);
+    else if(strcmp(argv[i],"--table")==0 && i+1<argc) accuracyOptions.tableFile=argv[++i];
+    else
+    { fprintf(stderr,"Usage: %s [--seed N] [--min-time S]\n"
+                     "       %s --accuracy [--seed N] [--samples N] [--precision P]"
+                     " [--threads N] [--table FILE]\n",argv[0],argv[0]);
+      return 1;
+    }
+  }
+  //The strategies build what else they need in their own process
+  error=(accuracy==POKER_TRUE) ? pokerInit() : pokerInitSevenCards();
+  if(error!=POKER_OK)
+  { fprintf(stderr,"%s\n",pokerErrorMessage(error));
+    return 1;
+  }
+  buildCorpus(seed);
+  accuracyOptions.seed=seed;
+  if(accuracy==POKER_TRUE)
+  { benchAccuracy();
+    return 0;
+  }
+  benchSortHand();
+  benchSortHands();
+  benchGetHandRank();
+  benchIsBetterHand();
+  benchRepeatCards();
+  benchEvaluateHand();
+  benchEvaluateSevenCards();
+  benchReferenceHandRank();
+  benchProbabilities("getProbabilities/exact",POKER_EXACT_MODE,0,seed,
+                     POKER_HAND_SIZE*(POKER_DECK_SIZE-POKER_HAND_SIZE));
+  benchProbabilities("getProbabilities/monte-carlo",POKER_MONTE_CARLO_MODE,BENCHMARK_SAMPLES,seed,
+                     POKER_HAND_SIZE*(double)BENCHMARK_SAMPLES);
+  benchProbabilities("getProbabilities/draw",POKER_DRAW_MODE,BENCHMARK_DRAW_SAMPLES,seed,0);
+  benchProbabilities("getProbabilities/holdem",POKER_HOLDEM_MODE,0,seed,
+                     (POKER_DECK_SIZE-POKER_HAND_SIZE)*(POKER_DECK_SIZE-POKER_HAND_SIZE-1)/2);
+  benchEquity(1,seed);
+  benchEquity(POKER_MAX_OPPONENTS,seed);
+  for(i=0; i<POKER_VARIANT_COUNT; ++i) benchVariant(i,seed);
+  return 0;
+}
+/********************************************************************
+* buildCorpus deals random hands from a generator seeded with seed and
+* keeps the first HANDS_PER_CATEGORY of every major rank. Straight
+* flushes come up once in about 65,000 hands, so filling the corpus
+* takes a few million deals, all through the lookup evaluator. The
+* seven card masks are dealt after the corpus, from the same generator.
+*
+* No returns, takes the seed of the corpus
+********************************************************************/
+void buildCorpus(uint64_t seed)
+{ PokerRandomState random;
+  int filled[POKER_STRAIGHT_FLUSH+1]={0}, total=0, category, i, index;
+  uint64_t mask;
+  pokerSeedRandom(&random,seed);
+  while(total<CORPUS_SIZE)
+  { for(mask=0; __builtin_popcountll(mask)<POKER_HAND_SIZE; )
+    { mask|=(uint64_t)1<<pokerRandomBelow(&random,POKER_DECK_SIZE);
+    }
+    category=pokerHandCategory(pokerEvaluateHand(mask));
+    if(filled[category]==HANDS_PER_CATEGORY) continue;
+    index=(category-1)*HANDS_PER_CATEGORY+filled[category]++;
+    ++total;
+    corpusMasks[index]=mask;
+    corpusHands[index].cardCount=POKER_HAND_SIZE;
+    for(i=0; i<POKER_HAND_SIZE; ++i, mask&=mask-1)
+    { corpusHands[index].cards[i]=__builtin_ctzll(mask);
+    }
+  }
+  for(index=0; index<CORPUS_SIZE; ++index)
+  { for(mask=corpusMasks[index]; __builtin_popcountll(mask)<POKER_MAX_HAND_CARDS; )
+    { mask|=(uint64_t)1<<pokerRandomBelow(&random,POKER_DECK_SIZE);
+    }
+    corpusSevenMasks[index]=mask;
+  }
+}
+/********************************************************************
+* now reads the monotonic clock
+*
+* Returns seconds from an arbitrary start
+********************************************************************/
+double now(void)
+{ struct timespec moment;
+  clock_gettime(CLOCK_MONOTONIC,&moment);
+  return moment.tv_sec+moment.tv_nsec*1e-9;
+}
+/********************************************************************
+* report prints the JSON line of one benchmark. perOp is how many
+* units of work one op is, per_second counts those units. kernel is
+* the evaluator kernel the engine picked for this CPU.
+********************************************************************/
+void report(const char *name, uint64_t ops, double seconds, double perOp, const char *unit)
+{ printf("{\"benchmark\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,"
+         "\"per_second\":%.0f,\"unit\":\"%s\",\"kernel\":\"%s\"}\n",
+         name,(unsigned long long)ops,seconds*1e9/ops,ops*perOp/seconds,unit,pokerKernelName());
+  fflush(stdout);
+}
+/********************************************************************
+* benchSortHand times pokerSortHand on corpus hands in their dealt
+* order, with the copy out of the corpus counted in
+********************************************************************/
+void benchSortHand(void)
+{ PokerHand hand;
+  uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i)
+    { hand=corpusHands[i];
+      pokerSortHand(&hand);
+      benchmarkSink+=hand.cards[0];
+    }
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("sortHand",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchSortHands times pokerSortHands on the whole corpus as one batch,
+* with the copy out of the corpus counted in
+********************************************************************/
+void benchSortHands(void)
+{ PokerHand hands[CORPUS_SIZE];
+  uint64_t ops=0;
+  double start=now(), seconds;
+  do
+  { memcpy(hands,corpusHands,sizeof(hands));
+    pokerSortHands(hands,CORPUS_SIZE);
+    benchmarkSink+=hands[0].cards[0];
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("sortHands",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchGetHandRank times scoring the input hand
+********************************************************************/
+void benchGetHandRank(void)
+{ uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i)
+    { benchmarkSink+=pokerGetHandRank(corpusMasks[i]);
+    }
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("getHandRank",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchIsBetterHand times comparing every corpus hand against the
+* score of the next one
+********************************************************************/
+void benchIsBetterHand(void)
+{ uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i)
+    { benchmarkSink+=pokerIsBetterHand(corpusMasks[i],
+                                         pokerEvaluateHand(corpusMasks[(i+1)%CORPUS_SIZE]));
+    }
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("isBetterHand",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchRepeatCards times the repeated card check of readLine
+********************************************************************/
+void benchRepeatCards(void)
+{ uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i)
+    { benchmarkSink+=pokerRepeatCards(&corpusHands[i]);
+    }
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("repeatCards",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchEvaluateHand times the lookup evaluator on its own
+********************************************************************/
+void benchEvaluateHand(void)
+{ uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i) benchmarkSink+=pokerEvaluateHand(corpusMasks[i]);
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("evaluateHand",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchEvaluateSevenCards times the seven card lookup evaluator on
+* the corpus hands with two more cards each
+********************************************************************/
+void benchEvaluateSevenCards(void)
+{ uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i) benchmarkSink+=pokerEvaluateSevenCards(corpusSevenMasks[i]);
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("evaluateSevenCards",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchReferenceHandRank times the reference classifier, the
+* baseline the lookup tables are measured against
+********************************************************************/
+void benchReferenceHandRank(void)
+{ int handID[POKER_HAND_ID_DIGITS];
+  uint64_t ops=0;
+  double start=now(), seconds;
+  int i;
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i)
+    { pokerReferenceHandRank(corpusMasks[i],handID);
+      benchmarkSink+=handID[POKER_MAJOR_RANK_DIGIT];
+    }
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  report("referenceHandRank",ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchProbabilities times working out the probabilities of one corpus
+* hand at a time in the given mode, as main does with pokerEvaluateHands
+* on a context of its own. Every hand is worked out in full, a cache
+* would time lookups instead. One line reports hands per second and,
+* when samplesPerHand is not 0, a second line reports candidate hands
+* evaluated per second.
+*
+* Takes the name, mode, sampleNumber (0 for the default), seed and
+* the candidates evaluated for each hand
+********************************************************************/
+void benchProbabilities(const char *name, int mode, int samples, uint64_t seed,
+                        double samplesPerHand)
+{ char samplesName[128];
+  PokerOptions options;
+  PokerContext *context;
+  PokerResult result;
+  uint64_t ops=0;
+  double start, seconds;
+  int i, error;
+  pokerInitOptions(&options);
+  options.mode=mode;
+  options.seed=seed;
+  options.cacheMegabytes=0;
+  if(samples>0) options.sampleNumber=samples;
+  if((error=pokerCreateContext(&options,&context))!=POKER_OK)
+  { fprintf(stderr,"%s: %s\n",name,pokerErrorMessage(error));
+    return;
+  }
+  start=now();
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i)
+    { pokerEvaluateHands(context,&corpusHands[i],1,&result);
+      benchmarkSink+=(uint64_t)result.probabilities[0];
+      ++ops;
+      if(mode!=POKER_EXACT_MODE && now()-start>=minTime) break;
+    }
+  }while((seconds=now()-start)<minTime);
+  pokerDestroyContext(context);
+  report(name,ops,seconds,1,"hands");
+  if(samplesPerHand>0)
+  { snprintf(samplesName,sizeof(samplesName),"%s/samples",name);
+    report(samplesName,ops,seconds,samplesPerHand,"samples");
+  }
+}
+/********************************************************************
+* benchEquity times POKER_EQUITY_MODE against opponents hands, one
+* hand per pokerEvaluateHands call like benchProbabilities, and reports
+* the deals per second too, so the cost of more opponents shows per
+* deal.
+*
+* Takes the number of opponents and the seed
+********************************************************************/
+void benchEquity(int opponents, uint64_t seed)
+{ char name[128];
+  PokerOptions options;
+  PokerContext *context;
+  PokerResult result;
+  uint64_t ops=0;
+  double start, seconds;
+  int i, error;
+  pokerInitOptions(&options);
+  options.mode=POKER_EQUITY_MODE;
+  options.opponents=opponents;
+  options.seed=seed;
+  options.cacheMegabytes=0;
+  options.sampleNumber=BENCHMARK_EQUITY_DEALS;
+  snprintf(name,sizeof(name),"getProbabilities/equity-%d",opponents);
+  if((error=pokerCreateContext(&options,&context))!=POKER_OK)
+  { fprintf(stderr,"%s: %s\n",name,pokerErrorMessage(error));
+    return;
+  }
+  start=now();
+  do
+  { for(i=0; i<CORPUS_SIZE && now()-start<minTime; ++i)
+    { pokerEvaluateHands(context,&corpusHands[i],1,&result);
+      benchmarkSink+=(uint64_t)result.equity;
+      ++ops;
+    }
+  }while((seconds=now()-start)<minTime);
+  pokerDestroyContext(context);
+  report(name,ops,seconds,1,"hands");
+  strcat(name,"/deals");
+  report(name,ops,seconds,BENCHMARK_EQUITY_DEALS,"deals");
+}
+/********************************************************************
+* benchVariant times one entry of the variant dispatch table, called
+* through its function pointer like a caller picking the variant at
+* run time, on CORPUS_SIZE random hands dealt out of its deck
+*
+* No returns, takes POKER_VARIANT(deck,cards) and the seed of the hands
+********************************************************************/
+void benchVariant(int variant, uint64_t seed)
+{ const PokerVariant *selected;
+  PokerRandomState random;
+  uint64_t masks[CORPUS_SIZE], mask, ops=0;
+  double start, seconds;
+  char name[64];
+  int i, error;
+  if((error=pokerInitVariant(variant,&selected))!=POKER_OK)
+  { fprintf(stderr,"%s\n",pokerErrorMessage(error));
+    return;
+  }
+  pokerSeedRandom(&random,seed+variant);
+  for(i=0; i<CORPUS_SIZE; ++i)
+  { for(mask=0; __builtin_popcountll(mask)<selected->cards; )
+    { mask|=((uint64_t)1<<pokerRandomBelow(&random,POKER_DECK_SIZE)) & selected->deckMask;
+    }
+    masks[i]=mask;
+  }
+  start=now();
+  do
+  { for(i=0; i<CORPUS_SIZE; ++i) benchmarkSink+=selected->evaluate(masks[i]);
+    ops+=CORPUS_SIZE;
+  }while((seconds=now()-start)<minTime);
+  snprintf(name,sizeof(name),"variant/%s",selected->name);
+  report(name,ops,seconds,1,"hands");
+}
+/********************************************************************
+* benchAccuracy runs the corpus once through every strategy and prints
+* a table with a row per strategy: wall and CPU seconds, peak resident
+* memory, the largest and the mean absolute error of its percentages
+* against exact, and the mean draws per discard. Every strategy runs
+* in a process of its own, so its CPU time and peak memory are its
+* own: the resident memory the child starts with, the five card
+* tables and the corpus it inherits from this process, is taken off.
+* Rows keep their order and their columns from release to release, so
+* two tables can be compared line by line. The table row is left out
+* without --table.
+*
+* No returns no parameters
+********************************************************************/
+void benchAccuracy(void)
+{ static StrategyRun exact, run;
+  struct rusage usage;
+  long inherited=inheritedMemory();
+  double wallTime, cpuTime, error, maxError, sumError;
+  int i, j, k;
+  printf("# corpus %d hands, samples %d, precision %.2f, threads %d, seed %llu, kernel %s\n",
+         CORPUS_SIZE,accuracyOptions.sampleNumber,accuracyOptions.precision,
+         accuracyOptions.threadCount,(unsigned long long)accuracyOptions.seed,pokerKernelName());
+  printf("%-24s %9s %9s %8s %9s %9s %10s\n","strategy","wall_s","cpu_s","rss_mb",
+         "max_err","mean_err","draws");
+  for(i=0; i<STRATEGY_COUNT; ++i)
+  { if(STRATEGIES[i].mode==POKER_TABLE_MODE && accuracyOptions.tableFile==NULL) continue;
+    if(measureStrategy(&STRATEGIES[i],(i==0) ? &exact : &run,&wallTime,&usage)==POKER_FALSE)
+    { if(i==0) return;
+      continue;
+    }
+    if(i==0) run=exact;
+    for(maxError=sumError=0, j=0; j<CORPUS_SIZE; ++j)
+    { for(k=0; k<POKER_HAND_SIZE; ++k)
+      { error=run.probabilities[j][k]-exact.probabilities[j][k];
+        if(error<0) error=-error;
+        if(error>maxError) maxError=error;
+        sumError+=error;
+      }
+    }
+    cpuTime=usage.ru_utime.tv_sec+usage.ru_utime.tv_usec*1e-6
+           +usage.ru_stime.tv_sec+usage.ru_stime.tv_usec*1e-6;
+    printf("%-24s %9.3f %9.3f %8.1f %9.3f %9.4f %10.0f\n",STRATEGIES[i].name,wallTime,cpuTime,
+           (usage.ru_maxrss-inherited)/1024.0,maxError,sumError/(CORPUS_SIZE*POKER_HAND_SIZE),run.draws);
+    fflush(stdout);
+  }
+}
+/********************************************************************
+* measureStrategy runs one strategy in a child process and reads back
+* its StrategyRun through a pipe
+*
+* Returns POKER_TRUE, or POKER_FALSE after printing why the strategy
+* did not run
+* Takes the strategy and fills its run, the wall seconds from the
+* fork to the exit and the resource usage of the child
+********************************************************************/
+int measureStrategy(const Strategy *strategy, StrategyRun *run, double *wallTime,
+                    struct rusage *usage)
+{ char *data=(char *)run;
+  size_t length=0;
+  ssize_t count;
+  double start=now();
+  int pipes[2], status;
+  pid_t child;
+  if(pipe(pipes)!=0 || (child=fork())<0)
+  { perror(strategy->name);
+    return POKER_FALSE;
+  }
+  if(child==0)
+  { close(pipes[0]);
+    runStrategy(strategy,run);
+    for(; length<sizeof(*run) && (count=write(pipes[1],data+length,sizeof(*run)-length))>0;
+        length+=count);
+    _exit(0);
+  }
+  close(pipes[1]);
+  for(; length<sizeof(*run) && (count=read(pipes[0],data+length,sizeof(*run)-length))>0;
+      length+=count);
+  close(pipes[0]);
+  if(wait4(child,&status,0,usage)<0)
+  { perror(strategy->name);
+    return POKER_FALSE;
+  }
+  *wallTime=now()-start;
+  //A short read means the child died before it could write its run
+  if(length<sizeof(*run))
+  { if(WIFSIGNALED(status))
+    { fprintf(stderr,"%s: killed by signal %d (%s)\n",strategy->name,WTERMSIG(status),
+              strsignal(WTERMSIG(status)));
+    }
+    else fprintf(stderr,"%s: exited with status %d before sending its results\n",
+                 strategy->name,WEXITSTATUS(status));
+    return POKER_FALSE;
+  }
+  if(run->status!=POKER_OK)
+  { fprintf(stderr,"%s: %s\n",strategy->name,pokerErrorMessage(run->status));
+    return POKER_FALSE;
+  }
+  return POKER_TRUE;
+}
+/********************************************************************
+* runStrategy is the child side of measureStrategy: one context with
+* the strategy's options and no cache, and one pokerEvaluateHands call
+* for the whole corpus
+*
+* No returns, takes the strategy and the run to fill
+********************************************************************/
+void runStrategy(const Strategy *strategy, StrategyRun *run)
+{ PokerOptions options=accuracyOptions;
+  PokerContext *context;
+  double draws=0;
+  int i, j;
+  options.mode=strategy->mode;
+  options.sampling=strategy->sampling;
+  options.cacheMegabytes=0;
+  if((run->status=pokerCreateContext(&options,&context))!=POKER_OK) return;
+  pokerEvaluateHands(context,corpusHands,CORPUS_SIZE,accuracyResults);
+  pokerDestroyContext(context);
+  for(i=0; i<CORPUS_SIZE; ++i)
+  { for(j=0; j<POKER_HAND_SIZE; ++j)
+    { run->probabilities[i][j]=accuracyResults[i].probabilities[j];
+      draws+=accuracyResults[i].samplesDrawn[j];
+    }
+  }
+  run->draws=(options.mode==POKER_MONTE_CARLO_MODE || options.mode==POKER_ADAPTIVE_MODE)
+             ? draws/(CORPUS_SIZE*POKER_HAND_SIZE) : 0;
+}
+/********************************************************************
+* inheritedMemory forks a child that exits straight away. Its peak
+* resident memory is what every strategy's child starts with.
+*
+* Returns the peak resident KB of the child, or 0 if it did not run
+* No parameters
+********************************************************************/
+long inheritedMemory(void)
+{ struct rusage usage;
+  int status;
+  pid_t child=fork();
+  if(child<0) return 0;
+  if(child==0) _exit(0);
+  if(wait4(child,&status,0,&usage)<0) return 0;
+  return usage.ru_maxrss;
+}
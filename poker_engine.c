@@ -0,0 +1,3791 @@
+/********************************************************************
+* Poker Hand Probability Engine
+*
+* The hand evaluator and every method of working out the probability
+* of improving a hand, moved out of the program so it can be built
+* into other programs. See poker_engine.h for the interface.
+*
+* Nothing here writes to a global once pokerInit has run. The lookup
+* tables are built once and only read after that, and every piece of
+* state that changes while a hand is worked out, from the canonical
+* hand to the cache and the thread pool, belongs to a PokerContext.
+* Two threads with a context each never touch the same memory.
+********************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//x86 kernels are compiled for their own target and picked at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h>
+#define AVX2_TARGET   __attribute__((target("avx2,popcnt")))
+#define AVX512_TARGET __attribute__((target("avx512f,popcnt")))
+#endif
+#include "poker_engine.h"
+//The engine's own short names for the public POKER_ constants
+#define DECK_SIZE               POKER_DECK_SIZE
+#define HAND_SIZE               POKER_HAND_SIZE
+#define HOLDEM_MIN_CARDS        POKER_HOLDEM_MIN_CARDS
+#define MAX_HAND_CARDS          POKER_MAX_HAND_CARDS
+#define SUIT_COUNT              POKER_SUIT_COUNT
+#define RANK_COUNT              POKER_RANK_COUNT
+#define FALSE                   POKER_FALSE
+#define TRUE                    POKER_TRUE
+#define HIGH_CARD               POKER_HIGH_CARD
+#define ONE_PAIR                POKER_ONE_PAIR
+#define TWO_PAIR                POKER_TWO_PAIR
+#define THREE_OF_A_KIND         POKER_THREE_OF_A_KIND
+#define STRAIGHT                POKER_STRAIGHT
+#define FLUSH                   POKER_FLUSH
+#define FULL_HOUSE              POKER_FULL_HOUSE
+#define FOUR_OF_A_KIND          POKER_FOUR_OF_A_KIND
+#define STRAIGHT_FLUSH          POKER_STRAIGHT_FLUSH
+#define CATEGORY_COUNT          POKER_CATEGORY_COUNT
+#define MAJOR_RANK_DIGIT        POKER_MAJOR_RANK_DIGIT
+#define MINOR_RANK_DIGIT        POKER_MINOR_RANK_DIGIT
+#define LOW_PAIR_DIGIT          POKER_LOW_PAIR_DIGIT
+#define EXACT_MODE              POKER_EXACT_MODE
+#define MONTE_CARLO_MODE        POKER_MONTE_CARLO_MODE
+#define ADAPTIVE_MODE           POKER_ADAPTIVE_MODE
+#define TABLE_MODE              POKER_TABLE_MODE
+#define DRAW_MODE               POKER_DRAW_MODE
+#define HOLDEM_MODE             POKER_HOLDEM_MODE
+#define EQUITY_MODE             POKER_EQUITY_MODE
+#define RANDOM_SAMPLING         POKER_RANDOM_SAMPLING
+#define STRATIFIED_SAMPLING     POKER_STRATIFIED_SAMPLING
+#define SOBOL_SAMPLING          POKER_SOBOL_SAMPLING
+#define DEFAULT_SAMPLE_NUMBER   POKER_DEFAULT_SAMPLE_NUMBER
+#define DEFAULT_CACHE_MEGABYTES POKER_DEFAULT_CACHE_MEGABYTES
+#define MAX_THREADS             POKER_MAX_THREADS
+#define MAX_OPPONENTS           POKER_MAX_OPPONENTS
+#define SUBSET_COUNT            POKER_SUBSET_COUNT
+#define HAND_CLASS_COUNT        POKER_HAND_CLASS_COUNT
+#define STANDARD_DECK           POKER_STANDARD_DECK
+#define SHORT_DECK              POKER_SHORT_DECK
+#define SHORT_DECK_LOW_RANK     POKER_SHORT_DECK_LOW_RANK
+#define SHORT_CLASS_COUNT       POKER_SHORT_CLASS_COUNT
+#define VARIANT_COUNT           POKER_VARIANT_COUNT
+#define VARIANT(deck,cards) POKER_VARIANT(deck,cards)
+#define DIGITS_IN_POKER_HAND_ID POKER_HAND_ID_DIGITS
+#define SAMPLE_CHUNK_SIZE     50000
+//Draws per independently randomized block, a power of two so the
+//points of a Sobol block are a net
+#define SAMPLE_BLOCK_SIZE     1024
+#define ADAPTIVE_MIN_BLOCKS   4
+#define SOBOL_BITS            32
+#define CONFIDENCE_Z          1.96
+#define MAX_CACHE_ENTRIES     (1<<28)
+#define CACHE_EMPTY           (-1)
+#define TABLE_MAGIC           "POKERTBL"
+#define TABLE_VERSION         2
+#define TABLE_HAND_COUNT      2598960
+#define SHARD_MAGIC           "POKERSHD"
+#define MERGE_BLOCK_SIZE      (1<<16)
+//FNV-1a 64 bit offset basis
+#define CHECKSUM_SEED         0xCBF29CE484222325ULL
+#define CANDIDATE_LANES       8
+#define AVX512_LANES          16
+#define DRAW_EXACT_LIMIT      3
+//Smallest multiple of 1...MAX_OPPONENTS+1, so every split pot is a
+//whole number of units
+#define EQUITY_SHARE_UNIT     2520
+#define ERROR_COUNT           10
+//Cards left after a hand, rounded up to whole vectors of either width
+#define CANDIDATE_LIMIT       ((DECK_SIZE-HAND_SIZE+AVX512_LANES-1)/AVX512_LANES*AVX512_LANES)
+#define SUIT_RANKS_MASK 0x1FFF
+#define WHEEL_RANKS     0x100F
+//Ranks 6 to A of a suit field, and A 6 7 8 9, the short deck wheel
+#define SHORT_DECK_RANKS  0x1FF0
+#define SHORT_WHEEL_RANKS 0x10F0
+//Rank digits of A 9 8 7 6 in a referenceHandKey, and the high card the
+//short deck wheel is keyed by, just below the 6 to 10 straight
+#define SHORT_WHEEL_DIGITS 0xE9876
+#define SHORT_WHEEL_HIGH   9
+//A suit field repeated in all four suits
+#define ALL_SUITS(field) ((uint64_t)(field)*0x8004002001ULL)
+#define FULL_DECK_MASK  ALL_SUITS(SUIT_RANKS_MASK)
+#define SHORT_DECK_MASK ALL_SUITS(SHORT_DECK_RANKS)
+#define HAS_SHORT_WHEEL(field) (((field) & SHORT_WHEEL_RANKS)==SHORT_WHEEL_RANKS)
+//Major rank in short deck order, flushes and full houses trade places
+#define SHORT_DECK_ORDER(category) ((category)==FLUSH ? FULL_HOUSE \
+                                    : (category)==FULL_HOUSE ? FLUSH : (category))
+#define STRAIGHT_RANKS  0x1F
+//Card bits are laid out suit by suit so every suit is one 13 bit field
+#define CARD_BIT(rankIndex,suitIndex) ((uint64_t)1<<((suitIndex)*RANK_COUNT+(rankIndex)))
+#define SUIT_RANKS(mask,suitIndex) ((int)(((mask)>>((suitIndex)*RANK_COUNT))&SUIT_RANKS_MASK))
+#define POPCOUNT(x) __builtin_popcountll(x)
+#define LOWEST_BIT(x) __builtin_ctz(x)
+#define HIGHEST_BIT(x) (31-__builtin_clz(x))
+#define MAX(a,b) ((a)>(b) ? (a) : (b))
+#define MIN(a,b) ((a)<(b) ? (a) : (b))
+//Sort key of a card, rank above suit, and the card of a sort key
+#define SORT_KEY(card) CARD_SORT_KEY[card]
+#define KEY_CARD(key) SORT_KEY_CARD[key]
+#define SORT_PLACE_BITS 3
+#define SORT_PLACE_MASK ((1<<SORT_PLACE_BITS)-1)
+#define SORT_LANES      32
+//The nine comparator sorting network for five values
+#define SORT_FIVE(SWAP,k) do{ SWAP(k[0],k[1]); SWAP(k[3],k[4]); SWAP(k[2],k[4]); \
+                              SWAP(k[2],k[3]); SWAP(k[0],k[3]); SWAP(k[0],k[2]); \
+                              SWAP(k[1],k[4]); SWAP(k[1],k[3]); SWAP(k[1],k[2]); }while(0)
+//Compare-exchanges for SORT_FIVE, each needs a variable low of its type
+#define COMPARE_SWAP(a,b) (low=MIN(a,b), b=MAX(a,b), a=low)
+#define LANE_COMPARE_SWAP(a,b) for(lane=0; lane<SORT_LANES; ++lane) COMPARE_SWAP(a[lane],b[lane])
+#define VECTOR_COMPARE_SWAP(a,b) (low=_mm256_min_epu8(a,b), b=_mm256_max_epu8(a,b), a=low)
+#define SUIT_MASK_COUNT (1<<RANK_COUNT)
+//Largest sum of RANK_KEY over a hand: four aces and a king
+#define RANK_KEY_SUM_LIMIT (4*79415+43258+1)
+//Largest sum of SIX_RANK_KEY over six cards: four aces, two kings
+#define SIX_KEY_SUM_LIMIT (4*436437+2*206930+1)
+//Largest sum of SEVEN_RANK_KEY over seven cards: four aces, three kings
+#define SEVEN_KEY_SUM_LIMIT (4*1479181+3*636345+1)
+//Bits of rank digits below the major rank of a referenceHandKey
+#define HAND_KEY_RANK_BITS (4*HAND_SIZE)
+
+/*********************************************************************
+* Global constants
+*
+*   RANK_KEY[]: one key per rank, picked greedily so that the sum of
+*     the keys of any HAND_SIZE cards (at most 4 of a rank) is unique.
+*     That sum is a perfect hash of the ranks of a hand, ignoring
+*     suits, and indexes rankTable[] directly.
+**********************************************************************/
+static const int RANK_KEY[RANK_COUNT] =
+{ 0, 1, 5, 22, 94, 312, 992, 2422, 5624, 12522, 19998, 43258, 79415 };
+/*********************************************************************
+*   SIX_RANK_KEY[]: RANK_KEY for six cards, picked the same greedy way
+*     so that the sum over any six cards is unique and indexes
+*     sixRankTable[].
+**********************************************************************/
+static const int SIX_RANK_KEY[RANK_COUNT] =
+{ 0, 1, 5, 22, 98, 422, 1734, 5760, 14270, 37951, 90838, 206930, 436437 };
+/*********************************************************************
+*   SEVEN_RANK_KEY[]: RANK_KEY for MAX_HAND_CARDS cards, picked the
+*     same greedy way so that the sum over any seven cards is unique
+*     and indexes sevenRankTable[]. Sums of fewer cards can collide.
+**********************************************************************/
+static const int SEVEN_RANK_KEY[RANK_COUNT] =
+{ 0, 1, 5, 22, 98, 453, 2031, 8698, 22854, 83661, 262349, 636345, 1479181 };
+/*********************************************************************
+*   SOBOL_DEGREE[]/SOBOL_COEFFICIENTS[]/SOBOL_INITIAL[][]: primitive
+*     polynomial and initial direction numbers of the first HAND_SIZE
+*     Sobol dimensions (Joe and Kuo), the first one being van der
+*     Corput's sequence
+**********************************************************************/
+static const int SOBOL_DEGREE[HAND_SIZE] = { 0, 1, 2, 3, 3 };
+static const int SOBOL_COEFFICIENTS[HAND_SIZE] = { 0, 0, 1, 1, 2 };
+static const uint32_t SOBOL_INITIAL[HAND_SIZE][3] =
+{ { 0, 0, 0 }, { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 }, { 1, 1, 1 } };
+/*********************************************************************
+*   CARD_SORT_KEY[]/SORT_KEY_CARD[]: a card's sort key rank<<2|suit,
+*     which orders cards by rank and then suit, and the card of a key
+**********************************************************************/
+static const uint8_t CARD_SORT_KEY[DECK_SIZE] =
+{
+   0,  4,  8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48,
+   1,  5,  9, 13, 17, 21, 25, 29, 33, 37, 41, 45, 49,
+   2,  6, 10, 14, 18, 22, 26, 30, 34, 38, 42, 46, 50,
+   3,  7, 11, 15, 19, 23, 27, 31, 35, 39, 43, 47, 51 };
+static const uint8_t SORT_KEY_CARD[DECK_SIZE] =
+{
+   0, 13, 26, 39,  1, 14, 27, 40,  2, 15, 28, 41,  3,
+  16, 29, 42,  4, 17, 30, 43,  5, 18, 31, 44,  6, 19,
+  32, 45,  7, 20, 33, 46,  8, 21, 34, 47,  9, 22, 35,
+  48, 10, 23, 36, 49, 11, 24, 37, 50, 12, 25, 38, 51 };
+/*********************************************************************
+*   ERROR_MESSAGES[]: what pokerErrorMessage says for every error code
+**********************************************************************/
+static const char *const ERROR_MESSAGES[ERROR_COUNT] =
+{ "No error", "Out of memory", "Could not start threads", "Lookup table build failed",
+  "Could not open the probability table", "Not a probability table of this version",
+  "Could not write the probability table", "Options out of range",
+  "Shards do not make up one whole table", "Checksum does not match the counts" };
+/********************************************************************
+* SampleTask is the state of one chunk of Monte Carlo samples. It is
+* all a worker thread reads or writes, so chunks never share memory.
+*   deck/deckSize: bits of the cards left in the deck, draws are
+*     picked straight out of it so none is ever rejected
+*   keptMask: the input hand without the discarded card
+*   handScore: score the drawn hands are compared against
+*   sampleCount: number of draws in the chunk, the cap when the chunk
+*     stops at a precision
+*   precision: confidence half-width in percentage points to stop
+*     at, 0 to always draw sampleCount cards
+*   sampling/histogram: the options of the context
+*   random: generator of the chunk, seeded per chunk
+*   numOfImprovements: result, draws that beat handScore
+*   samplesDrawn: result, draws actually made
+*   categories[]/scoreSum: result with histogram, draws by major
+*     rank and the sum of their scores
+*   blockCount/blockSquares/blockCross/blockSizes: result, number of
+*     blocks and the sums over them of improvements squared,
+*     improvements times draws and draws squared, for blockVariance
+********************************************************************/
+typedef struct
+{ const uint64_t *deck;
+  int  deckSize;
+  uint64_t keptMask;
+  int  handScore;
+  int  sampleCount;
+  double precision;
+  int  sampling;
+  int  histogram;
+  PokerRandomState random;
+  int  numOfImprovements;
+  int  samplesDrawn;
+  int  categories[CATEGORY_COUNT];
+  uint64_t scoreSum;
+  int  blockCount;
+  uint64_t blockSquares;
+  uint64_t blockCross;
+  uint64_t blockSizes;
+} SampleTask;
+/********************************************************************
+* CacheEntry holds the results of one canonical hand in the cache.
+*   mask/dead: the canonical hand and its canonical dead cards
+*   improvements/samplesDrawn/variances: canonicalImprovements[],
+*     canonicalSamplesDrawn[] and canonicalVariances[] as they were
+*     computed for it
+*   next: next entry in the same hash bucket, CACHE_EMPTY at the end
+*   referenced: set on every hit, cleared as the CLOCK hand passes
+********************************************************************/
+typedef struct
+{ uint64_t mask;
+  uint64_t dead;
+  int  improvements[HAND_SIZE];
+  int  samplesDrawn[HAND_SIZE];
+  float variances[HAND_SIZE];
+  int  next;
+  int  referenced;
+} CacheEntry;
+/********************************************************************
+* CacheOutcome holds the histogram results of the cache entry with the
+* same index, only kept with the histogram option so entries stay
+* small without it.
+*   categories/scoreSums: canonicalCategories[][] and
+*     canonicalScoreSums[] as they were computed
+********************************************************************/
+typedef struct
+{ int  categories[HAND_SIZE][CATEGORY_COUNT];
+  uint64_t scoreSums[HAND_SIZE];
+} CacheOutcome;
+/********************************************************************
+* DrawTask is one chunk of sampled draws of drawSize cards, the
+* sampled counterpart of enumerateDraws.
+*   drawSize/sampleCount: cards per draw and draws in the chunk
+*   random: generator of the chunk, seeded per chunk
+*   improvements/scoreSums: results, by place of the subset in
+*     drawSubsets[drawSize]
+********************************************************************/
+typedef struct
+{ int  drawSize;
+  int  sampleCount;
+  PokerRandomState random;
+  uint64_t improvements[SUBSET_COUNT];
+  uint64_t scoreSums[SUBSET_COUNT];
+} DrawTask;
+/********************************************************************
+* EquityTask is one chunk of random deals of EQUITY_MODE.
+*   sampleCount: deals in the chunk
+*   random: generator of the chunk, seeded per chunk
+*   wins/ties/shares: results, deals the hand beat every opponent
+*     in, deals it tied the best of them in, and its pot shares in
+*     EQUITY_SHARE_UNIT units
+*   evaluations: result, opponent hands scored
+********************************************************************/
+typedef struct
+{ int  sampleCount;
+  PokerRandomState random;
+  uint64_t wins;
+  uint64_t ties;
+  uint64_t shares;
+  uint64_t evaluations;
+} EquityTask;
+/********************************************************************
+* TableHeader starts a probability table file written by
+* pokerGenerateTable. The fields say what the counts after it were
+* made for, so a table from another version or card setup is refused.
+*   checksum: checksumCounts of all the counts after the header
+********************************************************************/
+typedef struct
+{ char magic[8];
+  uint32_t version;
+  uint32_t handSize;
+  uint32_t deckSize;
+  uint32_t reserved;
+  uint64_t handCount;
+  uint64_t checksum;
+} TableHeader;
+/********************************************************************
+* ShardHeader starts a shard file written by pokerGenerateTableShard.
+*   shardIndex/shardCount: which run of the split the file holds
+*   firstHand/handCount: tableIndex of its first hand and its hands
+*   checksum: checksumCounts of all the counts after the header
+********************************************************************/
+typedef struct
+{ char magic[8];
+  uint32_t version;
+  uint32_t handSize;
+  uint32_t deckSize;
+  uint32_t shardIndex;
+  uint32_t shardCount;
+  uint32_t reserved;
+  uint64_t firstHand;
+  uint64_t handCount;
+  uint64_t checksum;
+} ShardHeader;
+/********************************************************************
+* HandState is a hand kept in the form the lookup tables read, so
+* that adding or removing one card is O(1) and scoring it
+* is two loads. The rank key is a perfect hash of the rank counts,
+* so pairs, trips and quads come out of rankTable without counting,
+* and the suit fields are the rank mask of every suit.
+*   mask: the cards of the hand
+*   rankKey: sum of RANK_KEY over the cards
+*   suitFields: 13 bit rank field of each suit
+*   lastSuit: suit of the card added last
+********************************************************************/
+typedef struct
+{ uint64_t mask;
+  int  rankKey;
+  int  suitFields[SUIT_COUNT];
+  int  lastSuit;
+} HandState;
+/********************************************************************
+* CandidateDeck is remainingDeck split up for countImprovements, one
+* array per part of a card so a vector load takes CANDIDATE_LANES
+* cards at once.
+*   rankKey: RANK_KEY of the card's rank
+*   suit: suit index of the card
+*   rankBit: bit of the card inside its suit field
+*   count: number of cards, the rest of the lanes are padding
+********************************************************************/
+typedef struct
+{ int32_t rankKey[CANDIDATE_LIMIT];
+  int32_t suit[CANDIDATE_LIMIT];
+  int32_t rankBit[CANDIDATE_LIMIT];
+  int  count;
+} CandidateDeck;
+/********************************************************************
+* EvaluatorKernel is one entry of KERNELS[], the inner loops of the
+* exact modes and of pokerSortHands built for one instruction set.
+*   name: "scalar", "avx2" or "avx512", also what POKER_KERNEL names
+*   countImprovements/countOutcomes: see countImprovements
+*   sortKeys: sorts the columns of one block of pokerSortHands
+********************************************************************/
+typedef struct
+{ const char *name;
+  int  (*countImprovements)(const CandidateDeck *candidates, uint64_t keptMask, int score);
+  int  (*countOutcomes)(const CandidateDeck *candidates, uint64_t keptMask, int score,
+                        int categories[], uint64_t *scoreSum);
+  void (*sortKeys)(uint8_t keys[HAND_SIZE][SORT_LANES]);
+} EvaluatorKernel;
+/********************************************************************
+* ThreadPool hands the tasks of one runParallel call out to the
+* worker threads. Everything below lock is guarded by it.
+*   threadCount: threads running tasks, the one calling runParallel
+*     included, 0 for a pool that was never started
+*   generation: bumped for every job so sleeping workers notice it
+*   nextTask/taskCount: next task to hand out, and the end
+*   tasksLeft: tasks not yet finished, runParallel waits for 0
+********************************************************************/
+typedef struct
+{ pthread_t threads[MAX_THREADS];
+  int  threadCount;
+  pthread_mutex_t lock;
+  pthread_cond_t  workReady;
+  pthread_cond_t  workDone;
+  void (*run)(int, void *);
+  void *arg;
+  int  generation;
+  int  nextTask;
+  int  taskCount;
+  int  tasksLeft;
+  int  shutdown;
+} ThreadPool;
+/********************************************************************
+* PokerContext is everything that changes while hands are worked out.
+* A context is only ever used by one caller at a time, its pool
+* threads run tasks that only read it.
+*   options: the options the context was created with
+*   handMask/handScore: card mask and score of the hand being worked
+*     out, what pokerIsBetterHand compares candidates against
+*   deadMask: dead cards of the hand being worked out
+*   canonicalMask: the hand with its suits relabelled by
+*     canonicalizeHand, the same for every hand that only differs by
+*     a permutation of suits. The probabilities are worked out for it.
+*   suitMap[]: canonical suit index of every input suit index.
+*   canonicalDead: deadMask in the canonical suits, the cards
+*     remainingDeck[] leaves out besides canonicalMask.
+*   canonicalImprovements[]/canonicalSamplesDrawn[]: draws that
+*     improved and draws made for discarding each card of
+*     canonicalMask, lowest bit first, before placeProbabilities turns
+*     them into percentages in input order. canonicalVariances[] are
+*     the variances of the sampled ones.
+*   canonicalCategories[][]/canonicalScoreSums[]: with histogram,
+*     the draws of each discard by major rank and the sum of their
+*     scores.
+*   remainingDeck[]: bit of every card not in the hand, the first
+*     remainingCount entries are used.
+*   candidates: remainingDeck laid out for countImprovements.
+*   drawKeptKey[]/drawKeptFields[][]: rank key and suit fields of
+*     the cards every canonical subset keeps.
+*   drawImprovements[]/drawScoreSums[]/drawTrials[]: per canonical
+*     subset, draws that beat the input, the sum of the scores drawn
+*     to and the number of draws.
+*   equityWins/equityTies/equityShares/equityDeals: the EquityTask
+*     results of the hand added up.
+*   sampleTasks/drawTasks/equityTasks: task lists of the sampled
+*     methods, sized for the options once so no hand allocates
+*     anything.
+*   cacheEntries[]/cacheBuckets[]: cache of results by canonical
+*     hand, cacheCapacity entries chained off cacheBucketCount
+*     buckets. cacheUsed entries are filled, cacheClock is the CLOCK
+*     hand that picks the entry to evict. cacheOutcomes[] are the
+*     histograms of the entries, with histogram only.
+*   evaluations/cacheHits/cacheMisses/cacheEvictions: the counters
+*     pokerGetContextStats reports. The sample tasks count their own
+*     draws, so the threads share nothing and the counts are added
+*     up with the results.
+*   tableMap/tableSize: the mapped table file of TABLE_MODE,
+*     tableCounts are its counts in tableIndex order.
+*   pool: the options.threadCount-1 extra workers.
+********************************************************************/
+struct PokerContext
+{ PokerOptions options;
+  uint64_t handMask;
+  int  handScore;
+  uint64_t deadMask;
+  uint64_t canonicalMask;
+  int  suitMap[SUIT_COUNT];
+  uint64_t canonicalDead;
+  int  canonicalImprovements[HAND_SIZE];
+  int  canonicalSamplesDrawn[HAND_SIZE];
+  double canonicalVariances[HAND_SIZE];
+  int  canonicalCategories[HAND_SIZE][CATEGORY_COUNT];
+  uint64_t canonicalScoreSums[HAND_SIZE];
+  uint64_t remainingDeck[DECK_SIZE];
+  int  remainingCount;
+  CandidateDeck candidates;
+  int  drawKeptKey[SUBSET_COUNT];
+  int  drawKeptFields[SUBSET_COUNT][SUIT_COUNT];
+  uint64_t drawImprovements[SUBSET_COUNT];
+  uint64_t drawScoreSums[SUBSET_COUNT];
+  uint64_t drawTrials[SUBSET_COUNT];
+  uint64_t equityWins, equityTies, equityShares, equityDeals;
+  SampleTask *sampleTasks;
+  int  chunkCount;
+  DrawTask *drawTasks;
+  int  drawTaskCount;
+  EquityTask *equityTasks;
+  CacheEntry *cacheEntries;
+  CacheOutcome *cacheOutcomes;
+  int  *cacheBuckets;
+  int  cacheCapacity;
+  int  cacheBucketCount;
+  int  cacheUsed;
+  int  cacheClock;
+  uint64_t evaluations;
+  uint64_t cacheHits, cacheMisses, cacheEvictions;
+  void *tableMap;
+  size_t tableSize;
+  const uint8_t *tableCounts;
+  ThreadPool pool;
+};
+/********************************************************************
+* Shared Tables, built by pokerInit and read only after that
+*
+*   tablesOnce/tablesStatus: run buildHandTables and friends exactly
+*     once, and remember how it went.
+*   binomial[][]: binomial coefficients up to the deck size.
+*   drawSubsets[][]/drawSubsetCount[]: discard subsets by size.
+*   sobolDirections[][]: direction numbers of every Sobol dimension,
+*     point i of a block is the XOR of those of the bits of i's Gray
+*     code.
+*   suitRankKey[]: sum of RANK_KEY over the ranks of a 13 bit suit
+*     field, so the key of a hand is four loads and three adds.
+*   rankTable[]: score of every hand indexed by its rank key, valid
+*     for hands that are not flushes.
+*   flushTable[]: score of the best flush in a suit field holding
+*     HAND_SIZE to MAX_HAND_CARDS cards, 0 for every other field.
+*     Both have one spare entry so a 32 bit gather of the last
+*     16 bit entry stays inside the array.
+*   handClassKey[]: referenceHandKey of every hand class in sorted
+*     order, indexed by score.
+*   scoreCategory[]: major rank (HIGH_CARD...STRAIGHT_FLUSH) of
+*     every score.
+*   categoryFloor[]: lowest score of every major rank, and
+*     HAND_CLASS_COUNT+1 past STRAIGHT_FLUSH.
+*   sevenTablesOnce/sevenTablesStatus: run buildSevenCardTables
+*     exactly once, the first time a HOLDEM_MODE context needs it.
+*   suitSevenKey[]: sum of SEVEN_RANK_KEY over a suit field.
+*   sevenRankTable[]: best score without a flush of every seven card
+*     hand, indexed by its seven card rank key. It takes 15 MB, so it
+*     is only filled when it is used.
+*   sixTablesOnce/sixTablesStatus: run buildSixCardTables exactly
+*     once, the first time a six card variant or HOLDEM_MODE needs it.
+*   suitSixKey[]/sixRankTable[]: the same for six cards, 4 MB.
+*   shortTablesOnce/shortTablesStatus: run buildShortDeckTables
+*     exactly once, the first time a short deck variant is asked for.
+*   shortClassKey[]: shortDeckKey of every short deck hand class in
+*     sorted order, indexed by short deck score.
+*   shortScore[]: short deck score of every standard score whose
+*     ranks are all in the short deck, 0 for the others.
+*   shortCategory[]: major rank of every short deck score.
+*   shortFlushTable[]: flushTable in short deck scores, A 6 7 8 9
+*     suited included.
+*   shortWheel: short deck score of A 6 7 8 9 offsuit, which the
+*     standard order misplaces.
+*   kernelOnce/kernel: run selectKernel exactly once, and the entry
+*     of KERNELS[] it picked, the scalar one until then.
+********************************************************************/
+static pthread_once_t tablesOnce=PTHREAD_ONCE_INIT;
+static int  tablesStatus;
+static int  binomial[DECK_SIZE+1][HAND_SIZE+1];
+static int  drawSubsets[HAND_SIZE+1][SUBSET_COUNT];
+static int  drawSubsetCount[HAND_SIZE+1];
+static uint32_t sobolDirections[HAND_SIZE][SOBOL_BITS];
+static int  suitRankKey[SUIT_MASK_COUNT];
+static uint16_t rankTable[RANK_KEY_SUM_LIMIT+1];
+static uint16_t flushTable[SUIT_MASK_COUNT+1];
+static int  handClassKey[HAND_CLASS_COUNT+1];
+static uint8_t scoreCategory[HAND_CLASS_COUNT+1];
+static int  categoryFloor[STRAIGHT_FLUSH+2];
+static pthread_once_t sevenTablesOnce=PTHREAD_ONCE_INIT;
+static int  sevenTablesStatus;
+static int  suitSevenKey[SUIT_MASK_COUNT];
+static uint16_t sevenRankTable[SEVEN_KEY_SUM_LIMIT+1];
+static pthread_once_t sixTablesOnce=PTHREAD_ONCE_INIT;
+static int  sixTablesStatus;
+static int  suitSixKey[SUIT_MASK_COUNT];
+static uint16_t sixRankTable[SIX_KEY_SUM_LIMIT+1];
+static pthread_once_t shortTablesOnce=PTHREAD_ONCE_INIT;
+static int  shortTablesStatus;
+static int  shortClassKey[SHORT_CLASS_COUNT+1];
+static uint16_t shortScore[HAND_CLASS_COUNT+1];
+static uint8_t shortCategory[SHORT_CLASS_COUNT+1];
+static uint16_t shortFlushTable[SUIT_MASK_COUNT];
+static int  shortWheel;
+static pthread_once_t kernelOnce=PTHREAD_ONCE_INIT;
+
+static void buildSharedTables(void);
+static void buildSevenCardTables(void);
+static int  validOptions(const PokerOptions *options);
+static void getProbabilities(PokerContext *context, const PokerHand *hand, PokerResult *result);
+static void getCanonicalProbabilities(PokerContext *context);
+static uint64_t canonicalizeHand(uint64_t mask, uint64_t dead, int map[]);
+static uint64_t mapSuits(uint64_t mask, const int map[]);
+static int  liveCardsNeeded(const PokerContext *context, const PokerHand *hand);
+static void placeProbabilities(const PokerContext *context, const PokerHand *hand,
+                               PokerResult *result);
+static void placeHistogram(const PokerContext *context, int slot, int place, PokerResult *result);
+static int  startCache(PokerContext *context);
+static void stopCache(PokerContext *context);
+static int  cacheBucket(const PokerContext *context, uint64_t mask, uint64_t dead);
+static CacheEntry *lookupCache(PokerContext *context, uint64_t mask, uint64_t dead);
+static void storeCache(PokerContext *context, uint64_t mask, uint64_t dead);
+static int  tableIndex(uint64_t mask);
+static void buildBinomials(void);
+static int  nextCombination(int cardBits[], int size, int limit);
+static void handAtIndex(int index, int cardBits[]);
+static void generateCounts(PokerContext *context, int first, int count, uint8_t counts[]);
+static int  writeTableFile(const char *file, const void *header, size_t headerSize,
+                           const uint8_t counts[], int handCount);
+static int  readShardHeader(const char *file, ShardHeader *header);
+static int  copyShard(const char *file, const ShardHeader *header, FILE *output,
+                      uint64_t *tableChecksum);
+static uint64_t checksumCounts(uint64_t hash, const uint8_t counts[], size_t length);
+static int  mapTable(const char *file, const TableHeader **map);
+static int  openTable(PokerContext *context);
+static int  getTableProbabilities(const PokerContext *context, const PokerHand *hand,
+                                  PokerResult *result);
+static void getExactProbabilities(PokerContext *context);
+static void getRiverProbabilities(PokerContext *context);
+static void placeRiverProbabilities(const PokerContext *context, PokerResult *result);
+static void buildCandidates(PokerContext *context);
+static int  countImprovements(const CandidateDeck *candidates, uint64_t keptMask, int score);
+static int  countOutcomes(const CandidateDeck *candidates, uint64_t keptMask, int score,
+                          int categories[], uint64_t *scoreSum);
+static void sortKeys(uint8_t keys[HAND_SIZE][SORT_LANES]);
+#if defined(X86_KERNELS)
+static AVX2_TARGET int countImprovementsAvx2(const CandidateDeck *candidates, uint64_t keptMask,
+                                             int score);
+static AVX2_TARGET int countOutcomesAvx2(const CandidateDeck *candidates, uint64_t keptMask,
+                                         int score, int categories[], uint64_t *scoreSum);
+static AVX2_TARGET void sortKeysAvx2(uint8_t keys[HAND_SIZE][SORT_LANES]);
+static AVX512_TARGET int countImprovementsAvx512(const CandidateDeck *candidates, uint64_t keptMask,
+                                                 int score);
+static AVX512_TARGET int countOutcomesAvx512(const CandidateDeck *candidates, uint64_t keptMask,
+                                             int score, int categories[], uint64_t *scoreSum);
+#endif
+static void selectKernel(void);
+static int  buildRemainingDeck(uint64_t mask, uint64_t deck[]);
+static void getSampledProbabilities(PokerContext *context);
+static void runSampleTask(int taskIndex, void *arg);
+static double confidenceHalfWidth(int successes, int trials);
+static double blockVariance(int successes, int trials, int blocks, uint64_t squares,
+                            uint64_t cross, uint64_t sizes);
+static void buildSobolDirections(void);
+static void buildDrawSubsets(void);
+static void getDrawProbabilities(PokerContext *context);
+static void enumerateDraws(const PokerContext *context, HandState *drawn, int cardsLeft, int start,
+                           uint64_t improvements[], uint64_t scoreSums[]);
+static void scoreDraw(const PokerContext *context, const HandState *drawn,
+                      uint64_t improvements[], uint64_t scoreSums[]);
+static void sampleDraws(PokerContext *context);
+static void runDrawTask(int taskIndex, void *arg);
+static void placeDrawResults(const PokerContext *context, const PokerHand *hand,
+                             PokerResult *result);
+static void getEquity(PokerContext *context);
+static void runEquityTask(int taskIndex, void *arg);
+static uint64_t dealHand(uint8_t deck[], int start, int remainingCount, PokerRandomState *random);
+static void placeEquity(const PokerContext *context, PokerResult *result);
+static uint32_t pickBelow(PokerRandomState *random, uint32_t word, uint32_t bound);
+static uint64_t mixSeed(uint64_t seed, uint64_t hand, int chunk);
+static int  startThreadPool(ThreadPool *pool, int threadCount);
+static void stopThreadPool(ThreadPool *pool);
+static void runParallel(ThreadPool *pool, int taskCount, void (*run)(int, void *), void *arg);
+static void runPoolTasks(ThreadPool *pool);
+static void *poolWorker(void *arg);
+static int  buildHandTables(void);
+static void initHandState(HandState *state, uint64_t mask);
+static void addCard(HandState *state, int card);
+static void removeCard(HandState *state, int card);
+static int  handStateScore(const HandState *state);
+static int  referenceHandKey(uint64_t mask);
+static int  compareInts(const void *a, const void *b);
+static int  compareWords(const void *a, const void *b);
+static int  keyToScore(int key);
+static uint64_t dealRanks(const int ranks[], int *key);
+static int  nextRankSequence(int ranks[], int size);
+static int  isFlush(uint64_t mask);
+static int  isStraight(uint64_t mask);
+static int  isXOfAKind(uint64_t mask, int x);
+static int  isFullHouse(uint64_t mask);
+static int  isTwoPair(uint64_t mask);
+static int  highCard(uint64_t mask);
+static int  rankUnion(uint64_t mask);
+static int  ranksWithAtLeast(uint64_t mask, int x);
+static void buildSixCardTables(void);
+static void buildShortDeckTables(void);
+static int  shortDeckKey(int key);
+static int  evaluateShortFive(uint64_t mask);
+static int  evaluateShortSix(uint64_t mask);
+static int  evaluateShortSeven(uint64_t mask);
+static int  referenceVariantScore(const PokerVariant *variant, uint64_t mask);
+
+/*********************************************************************
+*   VARIANTS[]: the variant dispatch table, indexed by VARIANT(deck,
+*     cards). Every entry has an evaluator of its own with the hand
+*     size built in, none of them loops over the cards.
+**********************************************************************/
+static const PokerVariant VARIANTS[VARIANT_COUNT] =
+{ { "standard-5", STANDARD_DECK, 5, FULL_DECK_MASK, HAND_CLASS_COUNT, pokerEvaluateHand,
+    scoreCategory },
+  { "standard-6", STANDARD_DECK, 6, FULL_DECK_MASK, HAND_CLASS_COUNT, pokerEvaluateSixCards,
+    scoreCategory },
+  { "standard-7", STANDARD_DECK, 7, FULL_DECK_MASK, HAND_CLASS_COUNT, pokerEvaluateSevenCards,
+    scoreCategory },
+  { "short-5", SHORT_DECK, 5, SHORT_DECK_MASK, SHORT_CLASS_COUNT, evaluateShortFive,
+    shortCategory },
+  { "short-6", SHORT_DECK, 6, SHORT_DECK_MASK, SHORT_CLASS_COUNT, evaluateShortSix,
+    shortCategory },
+  { "short-7", SHORT_DECK, 7, SHORT_DECK_MASK, SHORT_CLASS_COUNT, evaluateShortSeven,
+    shortCategory } };
+/*********************************************************************
+*   KERNELS[]: the evaluator kernels from narrowest to widest. Only the
+*     scalar one exists off x86, where NEON has no gather to offer.
+*     AVX-512 sorts with the AVX2 kernel, a block of pokerSortHands is
+*     one 256 bit row per card.
+**********************************************************************/
+static const EvaluatorKernel KERNELS[] =
+{ { "scalar", countImprovements, countOutcomes, sortKeys },
+#if defined(X86_KERNELS)
+  { "avx2", countImprovementsAvx2, countOutcomesAvx2, sortKeysAvx2 },
+  { "avx512", countImprovementsAvx512, countOutcomesAvx512, sortKeysAvx2 },
+#endif
+};
+static const EvaluatorKernel *kernel=&KERNELS[0];
+
+/********************************************************************
+* pokerInit builds the shared lookup tables the first time it is
+* called, from whichever thread gets there first. Every later call
+* waits for that build and returns how it went.
+*
+* Returns POKER_OK, or POKER_TABLES_FAILED
+********************************************************************/
+int pokerInit(void)
+{ pthread_once(&kernelOnce,selectKernel);
+  pthread_once(&tablesOnce,buildSharedTables);
+  return tablesStatus;
+}
+/********************************************************************
+* selectKernel picks the widest kernel of KERNELS[] the CPU runs, from
+* CPUID. The POKER_KERNEL environment variable can name a narrower one
+* instead, to compare them on one machine. A name the CPU cannot run
+* is ignored.
+*
+* No returns no parameters, sets kernel
+********************************************************************/
+static void selectKernel(void)
+{ const char *name=getenv("POKER_KERNEL");
+  int widest=0, i;
+#if defined(X86_KERNELS)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) widest=1;
+  if(widest==1 && __builtin_cpu_supports("avx512f")) widest=2;
+#endif
+  kernel=&KERNELS[widest];
+  for(i=0; name!=NULL && i<widest; ++i)
+  { if(strcmp(name,KERNELS[i].name)==0) kernel=&KERNELS[i];
+  }
+}
+/********************************************************************
+* pokerKernelName names the kernel selectKernel picked for this CPU
+*
+* Returns "scalar", "avx2" or "avx512"
+********************************************************************/
+const char *pokerKernelName(void)
+{ pthread_once(&kernelOnce,selectKernel);
+  return kernel->name;
+}
+/********************************************************************
+* buildSharedTables is the body of pokerInit, run once
+*
+* No returns no parameters, sets tablesStatus
+********************************************************************/
+static void buildSharedTables(void)
+{ if(buildHandTables()==FALSE)
+  { tablesStatus=POKER_TABLES_FAILED;
+    return;
+  }
+  buildBinomials();
+  buildDrawSubsets();
+  buildSobolDirections();
+  tablesStatus=POKER_OK;
+}
+/********************************************************************
+* pokerInitSevenCards builds the six and seven card tables on top of
+* the shared ones, once, like pokerInit. pokerCreateContext calls it for
+* HOLDEM_MODE, where a turn has six cards, and pokerEvaluateSevenCards
+* needs it to have run.
+*
+* Returns POKER_OK, or POKER_TABLES_FAILED
+********************************************************************/
+int pokerInitSevenCards(void)
+{ int error;
+  if((error=pokerInit())!=POKER_OK) return error;
+  pthread_once(&sixTablesOnce,buildSixCardTables);
+  if(sixTablesStatus!=POKER_OK) return sixTablesStatus;
+  pthread_once(&sevenTablesOnce,buildSevenCardTables);
+  return sevenTablesStatus;
+}
+/********************************************************************
+* buildSevenCardTables is the body of pokerInitSevenCards. Every
+* multiset of MAX_HAND_CARDS ranks (at most 4 of a rank) gets the best
+* score of the 21 ways to keep five of them out of rankTable. The
+* subsets are only walked here, pokerEvaluateSevenCards never does.
+*
+* No returns no parameters, sets sevenTablesStatus
+********************************************************************/
+static void buildSevenCardTables(void)
+{ int ranks[MAX_HAND_CARDS], i, j, field, key, fiveKey, score;
+  for(field=0; field<SUIT_MASK_COUNT; ++field)
+  { suitSevenKey[field]=0;
+    for(i=0; i<RANK_COUNT; ++i)
+    { if(field & (1<<i)) suitSevenKey[field]+=SEVEN_RANK_KEY[i];
+    }
+  }
+  memset(ranks,0,sizeof(ranks));
+  do
+  { //Ranks are in order, five of a kind is a rank repeated 4 places on
+    for(i=0; i+SUIT_COUNT<MAX_HAND_CARDS && ranks[i]!=ranks[i+SUIT_COUNT]; ++i);
+    if(i+SUIT_COUNT<MAX_HAND_CARDS) continue;
+    for(key=fiveKey=0, i=0; i<MAX_HAND_CARDS; ++i)
+    { key+=SEVEN_RANK_KEY[ranks[i]];
+      fiveKey+=RANK_KEY[ranks[i]];
+    }
+    if(sevenRankTable[key]!=0)
+    { sevenTablesStatus=POKER_TABLES_FAILED;
+      return;
+    }
+    for(score=0, i=0; i<MAX_HAND_CARDS; ++i)
+    { for(j=i+1; j<MAX_HAND_CARDS; ++j)
+      { score=MAX(score,rankTable[fiveKey-RANK_KEY[ranks[i]]-RANK_KEY[ranks[j]]]);
+      }
+    }
+    sevenRankTable[key]=score;
+  }while(nextRankSequence(ranks,MAX_HAND_CARDS)==TRUE);
+  sevenTablesStatus=POKER_OK;
+}
+/********************************************************************
+* buildSixCardTables is buildSevenCardTables for six cards: every
+* multiset of six ranks gets the best rankTable score of the six ways
+* to leave one out, so pokerEvaluateSixCards needs a single load.
+*
+* No returns no parameters, sets sixTablesStatus
+********************************************************************/
+static void buildSixCardTables(void)
+{ int ranks[HAND_SIZE+1], i, field, key, fiveKey, score;
+  for(field=0; field<SUIT_MASK_COUNT; ++field)
+  { suitSixKey[field]=0;
+    for(i=0; i<RANK_COUNT; ++i)
+    { if(field & (1<<i)) suitSixKey[field]+=SIX_RANK_KEY[i];
+    }
+  }
+  memset(ranks,0,sizeof(ranks));
+  do
+  { if(ranks[0]==ranks[SUIT_COUNT] || ranks[1]==ranks[SUIT_COUNT+1]) continue;
+    for(key=fiveKey=0, i=0; i<HAND_SIZE+1; ++i)
+    { key+=SIX_RANK_KEY[ranks[i]];
+      fiveKey+=RANK_KEY[ranks[i]];
+    }
+    if(sixRankTable[key]!=0)
+    { sixTablesStatus=POKER_TABLES_FAILED;
+      return;
+    }
+    for(score=0, i=0; i<HAND_SIZE+1; ++i)
+    { score=MAX(score,rankTable[fiveKey-RANK_KEY[ranks[i]]]);
+    }
+    sixRankTable[key]=score;
+  }while(nextRankSequence(ranks,HAND_SIZE+1)==TRUE);
+  sixTablesStatus=POKER_OK;
+}
+/********************************************************************
+* pokerInitVariant builds the tables a variant's evaluator reads, once
+* for every process like pokerInit: the six or seven card tables for
+* those sizes and the short deck tables for short deck ones.
+*
+* Returns POKER_OK with *selected set to the variant's entry of the
+* dispatch table, POKER_BAD_OPTIONS for a variant out of range, or
+* POKER_TABLES_FAILED
+* Takes VARIANT(deck,cards)
+********************************************************************/
+int pokerInitVariant(int variant, const PokerVariant **selected)
+{ int error;
+  if(variant<0 || variant>=VARIANT_COUNT) return POKER_BAD_OPTIONS;
+  error=(VARIANTS[variant].cards==MAX_HAND_CARDS) ? pokerInitSevenCards() : pokerInit();
+  if(error==POKER_OK && VARIANTS[variant].cards==HAND_SIZE+1)
+  { pthread_once(&sixTablesOnce,buildSixCardTables);
+    error=sixTablesStatus;
+  }
+  if(error==POKER_OK && VARIANTS[variant].deck==SHORT_DECK)
+  { pthread_once(&shortTablesOnce,buildShortDeckTables);
+    error=shortTablesStatus;
+  }
+  if(error==POKER_OK) *selected=&VARIANTS[variant];
+  return error;
+}
+/********************************************************************
+* buildShortDeckTables is the body of pokerInitVariant for the short
+* deck. The short deck key of every standard hand class without a 2
+* to 5 is sorted like buildHandTables sorts the standard ones, and
+* shortScore maps each standard score to the place of its key. The
+* short deck evaluators then look up the standard rank tables and map
+* the score, so none of the big tables is built twice. Only the flush
+* table is small enough to get a short deck copy of its own.
+*
+* No returns no parameters, sets shortTablesStatus
+********************************************************************/
+static void buildShortDeckTables(void)
+{ int score, key, field, count=0, *found;
+  for(score=1; score<=HAND_CLASS_COUNT; ++score)
+  { if((key=shortDeckKey(handClassKey[score]))==0) continue;
+    if(count==SHORT_CLASS_COUNT)
+    { shortTablesStatus=POKER_TABLES_FAILED;
+      return;
+    }
+    shortClassKey[++count]=key;
+  }
+  if(count!=SHORT_CLASS_COUNT)
+  { shortTablesStatus=POKER_TABLES_FAILED;
+    return;
+  }
+  qsort(shortClassKey+1,SHORT_CLASS_COUNT,sizeof(int),compareInts);
+  for(score=1; score<=SHORT_CLASS_COUNT; ++score)
+  { shortCategory[score]=SHORT_DECK_ORDER(shortClassKey[score]>>HAND_KEY_RANK_BITS);
+  }
+  shortScore[0]=0;
+  for(score=1; score<=HAND_CLASS_COUNT; ++score)
+  { key=shortDeckKey(handClassKey[score]);
+    found=bsearch(&key,shortClassKey+1,SHORT_CLASS_COUNT,sizeof(int),compareInts);
+    shortScore[score]=(key!=0 && found!=NULL) ? (int)(found-shortClassKey) : 0;
+  }
+  //The ace in another suit than 6 7 8 9
+  shortWheel=shortScore[pokerEvaluateHand(CARD_BIT(RANK_COUNT-1,1)
+                                          |(SHORT_WHEEL_RANKS & ~(1<<(RANK_COUNT-1))))];
+  for(field=0; field<SUIT_MASK_COUNT; ++field)
+  { shortFlushTable[field]=shortScore[flushTable[field]];
+    if(HAS_SHORT_WHEEL(field) && POPCOUNT(field)<=MAX_HAND_CARDS)
+    { shortFlushTable[field]=MAX(shortFlushTable[field],shortScore[flushTable[SHORT_WHEEL_RANKS]]);
+    }
+  }
+  shortTablesStatus=POKER_OK;
+}
+/********************************************************************
+* shortDeckKey turns the referenceHandKey of a standard hand into its
+* key in the short deck order. A 9 8 7 6 becomes the lowest straight,
+* or straight flush, and the major ranks go in SHORT_DECK_ORDER. Rank
+* digits are unchanged, so short deck keys sort like the standard ones.
+*
+* Returns the key, 0 for a hand holding a 2 to 5
+********************************************************************/
+static int shortDeckKey(int key)
+{ int category=key>>HAND_KEY_RANK_BITS, digits=key & ((1<<HAND_KEY_RANK_BITS)-1), rest;
+  if(category==STRAIGHT || category==STRAIGHT_FLUSH)
+  { if(digits-(HAND_SIZE-1)<SHORT_DECK_LOW_RANK+2) return 0;
+  }
+  else
+  { //Ranks with fewer than five digits are padded with zero digits
+    for(rest=digits; rest!=0; rest>>=4)
+    { if((rest & 0xF)!=0 && (rest & 0xF)<SHORT_DECK_LOW_RANK+2) return 0;
+    }
+    if(digits==SHORT_WHEEL_DIGITS)
+    { category=(category==FLUSH) ? STRAIGHT_FLUSH : STRAIGHT;
+      digits=SHORT_WHEEL_HIGH;
+    }
+  }
+  return SHORT_DECK_ORDER(category)<<HAND_KEY_RANK_BITS | digits;
+}
+/********************************************************************
+* pokerInitOptions fills in the defaults: exact probabilities on one
+* thread with a 16 MB cache
+********************************************************************/
+void pokerInitOptions(PokerOptions *options)
+{ memset(options,0,sizeof(*options));
+  options->mode=EXACT_MODE;
+  options->sampleNumber=DEFAULT_SAMPLE_NUMBER;
+  options->opponents=1;
+  options->threadCount=1;
+  options->cacheMegabytes=DEFAULT_CACHE_MEGABYTES;
+}
+/********************************************************************
+* validOptions checks that options describe something a context can do
+*
+* Returns TRUE or FALSE
+********************************************************************/
+static int validOptions(const PokerOptions *options)
+{ switch(options->mode)
+  { case EXACT_MODE:
+    case MONTE_CARLO_MODE:
+    case DRAW_MODE:
+      break;
+    case HOLDEM_MODE:
+      break;
+    case EQUITY_MODE:
+      if(options->opponents<1 || options->opponents>MAX_OPPONENTS) return FALSE;
+      break;
+    case ADAPTIVE_MODE:
+      if(options->precision<=0) return FALSE;
+      break;
+    case TABLE_MODE:
+      if(options->tableFile==NULL) return FALSE;
+      break;
+    default:
+      return FALSE;
+  }
+  if(options->histogram==TRUE && options->mode!=EXACT_MODE
+     && options->mode!=MONTE_CARLO_MODE && options->mode!=ADAPTIVE_MODE) return FALSE;
+  return options->sampleNumber>=1 && options->threadCount>=1
+         && options->sampling>=RANDOM_SAMPLING && options->sampling<=SOBOL_SAMPLING
+         && options->threadCount<=MAX_THREADS && options->cacheMegabytes>=0;
+}
+/********************************************************************
+* pokerCreateContext sets up a context for options: its cache, the task
+* lists of the sampled methods, its thread pool and, in TABLE_MODE,
+* the mapped table. All the memory a context needs is had here, so
+* pokerEvaluateHands cannot run out of it.
+*
+* Returns POKER_OK and the context in *context, or an error code and
+* NULL in *context
+********************************************************************/
+int pokerCreateContext(const PokerOptions *options, PokerContext **context)
+{ PokerContext *created;
+  int error;
+  *context=NULL;
+  if((error=pokerInit())!=POKER_OK) return error;
+  if(validOptions(options)==FALSE) return POKER_BAD_OPTIONS;
+  if(options->mode==HOLDEM_MODE && (error=pokerInitSevenCards())!=POKER_OK) return error;
+  if((created=calloc(1,sizeof(PokerContext)))==NULL) return POKER_NO_MEMORY;
+  created->options=*options;
+  created->chunkCount=(options->mode==ADAPTIVE_MODE) ? 1
+                     : (options->sampleNumber+SAMPLE_CHUNK_SIZE-1)/SAMPLE_CHUNK_SIZE;
+  if(options->mode==MONTE_CARLO_MODE || options->mode==ADAPTIVE_MODE)
+  { created->sampleTasks=malloc(HAND_SIZE*created->chunkCount*sizeof(SampleTask));
+    if(created->sampleTasks==NULL) error=POKER_NO_MEMORY;
+  }
+  if(options->mode==DRAW_MODE && DRAW_EXACT_LIMIT<HAND_SIZE)
+  { created->drawTaskCount=(HAND_SIZE-DRAW_EXACT_LIMIT)*created->chunkCount;
+    created->drawTasks=malloc(created->drawTaskCount*sizeof(DrawTask));
+    if(created->drawTasks==NULL) error=POKER_NO_MEMORY;
+  }
+  if(options->mode==EQUITY_MODE)
+  { created->equityTasks=malloc(created->chunkCount*sizeof(EquityTask));
+    if(created->equityTasks==NULL) error=POKER_NO_MEMORY;
+  }
+  if(error==POKER_OK && startCache(created)==FALSE) error=POKER_NO_MEMORY;
+  if(error==POKER_OK && options->mode==TABLE_MODE) error=openTable(created);
+  if(error==POKER_OK && startThreadPool(&created->pool,options->threadCount)==FALSE)
+  { error=POKER_NO_THREADS;
+  }
+  if(error!=POKER_OK)
+  { pokerDestroyContext(created);
+    return error;
+  }
+  *context=created;
+  return POKER_OK;
+}
+/********************************************************************
+* pokerDestroyContext stops the threads of a context and frees
+* everything it holds. Takes NULL as well.
+********************************************************************/
+void pokerDestroyContext(PokerContext *context)
+{ if(context==NULL) return;
+  stopThreadPool(&context->pool);
+  stopCache(context);
+  if(context->tableMap!=NULL) munmap(context->tableMap,context->tableSize);
+  free(context->sampleTasks);
+  free(context->drawTasks);
+  free(context->equityTasks);
+  free(context);
+}
+/********************************************************************
+* pokerEvaluateHands scores count hands and works out their
+* probabilities with the method of the context, one result per hand. A
+* hand with a card off the deck, a repeated card, a card count the mode
+* does not take, a dead card it holds itself or too few live cards left
+* gets status FALSE and does not stop the rest of the batch.
+*
+* Returns the number of hands that were good
+********************************************************************/
+int pokerEvaluateHands(PokerContext *context, const PokerHand hands[], int count,
+                       PokerResult results[])
+{ int i, j, cards, valid=0;
+  for(i=0; i<count; ++i)
+  { results[i].status=FALSE;
+    cards=hands[i].cardCount;
+    if(cards!=HAND_SIZE && (context->options.mode!=HOLDEM_MODE
+                            || cards<HOLDEM_MIN_CARDS || cards>MAX_HAND_CARDS)) continue;
+    for(j=0; j<cards && hands[i].cards[j]<DECK_SIZE; ++j);
+    if(j<cards || pokerRepeatCards(&hands[i])==TRUE) continue;
+    context->handMask=pokerHandToMask(&hands[i]);
+    context->deadMask=hands[i].deadMask;
+    if((context->deadMask>>DECK_SIZE)!=0 || (context->deadMask & context->handMask)!=0
+       || DECK_SIZE-POPCOUNT(context->handMask|context->deadMask)
+          <liveCardsNeeded(context,&hands[i])) continue;
+    context->handScore=pokerGetBestHandRank(context->handMask);
+    results[i].score=context->handScore;
+    results[i].category=scoreCategory[context->handScore];
+    getProbabilities(context,&hands[i],&results[i]);
+    results[i].status=TRUE;
+    ++valid;
+  }
+  return valid;
+}
+/********************************************************************
+* liveCardsNeeded is the least number of live cards the mode of the
+* context has to draw from for a hand: one replacement, a whole draw,
+* the rest of the board or every opponent's hand.
+*
+* Returns the number of cards
+********************************************************************/
+static int liveCardsNeeded(const PokerContext *context, const PokerHand *hand)
+{ switch(context->options.mode)
+  { case DRAW_MODE:
+      return HAND_SIZE;
+    case HOLDEM_MODE:
+      return MAX_HAND_CARDS-hand->cardCount;
+    case EQUITY_MODE:
+      return context->options.opponents*HAND_SIZE;
+    default:
+      return 1;
+  }
+}
+/********************************************************************
+* pokerGetContextStats copies out the counters of a context
+********************************************************************/
+void pokerGetContextStats(const PokerContext *context, PokerStats *stats)
+{ stats->evaluations=context->evaluations;
+  stats->cacheHits=context->cacheHits;
+  stats->cacheMisses=context->cacheMisses;
+  stats->cacheEvictions=context->cacheEvictions;
+  stats->cacheUsed=context->cacheUsed;
+  stats->cacheCapacity=context->cacheCapacity;
+}
+/********************************************************************
+* pokerErrorMessage names an error code
+*
+* Returns a constant string
+********************************************************************/
+const char *pokerErrorMessage(int error)
+{ return (error>=0 && error<ERROR_COUNT) ? ERROR_MESSAGES[error] : "Unknown error";
+}
+/********************************************************************
+* pokerHandToMask packs the cards of a hand into a 52 bit card mask.
+* Repeated cards collapse onto the same bit, so the mask has fewer
+* than cardCount bits set when the hand has a repeat.
+*
+* Returns the card mask, takes a hand of cards below DECK_SIZE
+********************************************************************/
+uint64_t pokerHandToMask(const PokerHand *hand)
+{ int i;
+  uint64_t mask=0;
+  for(i=0; i<hand->cardCount; ++i) mask|=(uint64_t)1<<hand->cards[i];
+  return mask;
+}
+/********************************************************************
+* Determines whether or not a repeat card is in a hand.
+* Two equal cards land on the same bit of the card mask, so a single
+* popcount replaces comparing every pair of cards.
+*
+* Returns TRUE if hand has repeated cards
+*         FALSE if not
+*************************************/
+int pokerRepeatCards(const PokerHand *hand)
+{ return (POPCOUNT(pokerHandToMask(hand))!=hand->cardCount) ? TRUE : FALSE;
+}
+/********************************************************************
+* pokerHandCategory gives the major rank of a score
+*
+* Returns HIGH_CARD...STRAIGHT_FLUSH
+********************************************************************/
+int pokerHandCategory(int score)
+{ return scoreCategory[score];
+}
+/************************************************************************
+* Calculates a series probabilities for the likelihood of improving the
+* rank of the hand in context->handMask by discarding a certain card.
+* The results are a parallel array with the cards of hand. The mode of
+* the context picks the exact or sampled method.
+*
+* Hands that only differ by a permutation of suits improve the same way,
+* so the work is done on the canonical form of the hand and the result
+* of each card is carried back to its place in the input. Canonical hands
+* seen before come out of the cache. Sampled results are cached too, they
+* only depend on the seed and the canonical hand. Dead cards are
+* relabelled with the hand and the cache is keyed on both. With a table
+* there is nothing to work out at all, unless there are dead cards,
+* which the table does not know about, so those hands are worked out
+* exactly, like a hand with a bad count in the table. EQUITY_MODE plays the canonical hand
+* against random opponents instead, the suits do not matter to them
+* either.
+*
+* No returns, fills the probabilities of result
+**************************************************************************/
+static void getProbabilities(PokerContext *context, const PokerHand *hand, PokerResult *result)
+{ if(context->options.mode==TABLE_MODE && context->deadMask==0
+     && getTableProbabilities(context,hand,result)==TRUE)
+  { return;
+  }
+  context->canonicalMask=canonicalizeHand(context->handMask,context->deadMask,context->suitMap);
+  context->canonicalDead=mapSuits(context->deadMask,context->suitMap);
+  if(context->options.mode==DRAW_MODE)
+  { getDrawProbabilities(context);
+    placeDrawResults(context,hand,result);
+    return;
+  }
+  if(context->options.mode==EQUITY_MODE)
+  { getEquity(context);
+    placeEquity(context,result);
+    return;
+  }
+  getCanonicalProbabilities(context);
+  if(context->options.mode==HOLDEM_MODE) placeRiverProbabilities(context,result);
+  else placeProbabilities(context,hand,result);
+}
+/************************************************************************
+* getCanonicalProbabilities fills canonicalImprovements[],
+* canonicalSamplesDrawn[] and with histogram canonicalCategories[][]
+* and canonicalScoreSums[] for canonicalMask, from the cache when it
+* can and with the method of the context when it cannot.
+*
+* No returns, takes the context
+**************************************************************************/
+static void getCanonicalProbabilities(PokerContext *context)
+{ CacheEntry *entry;
+  CacheOutcome *outcome;
+  int i;
+  if((entry=lookupCache(context,context->canonicalMask,context->canonicalDead))!=NULL)
+  { memcpy(context->canonicalImprovements,entry->improvements,
+           sizeof(context->canonicalImprovements));
+    memcpy(context->canonicalSamplesDrawn,entry->samplesDrawn,
+           sizeof(context->canonicalSamplesDrawn));
+    for(i=0; i<HAND_SIZE; ++i) context->canonicalVariances[i]=entry->variances[i];
+    if(context->options.histogram==TRUE)
+    { outcome=&context->cacheOutcomes[entry-context->cacheEntries];
+      memcpy(context->canonicalCategories,outcome->categories,
+             sizeof(context->canonicalCategories));
+      memcpy(context->canonicalScoreSums,outcome->scoreSums,sizeof(context->canonicalScoreSums));
+    }
+  }
+  else
+  { context->remainingCount=buildRemainingDeck(context->canonicalMask|context->canonicalDead,
+                                                 context->remainingDeck);
+    memset(context->canonicalVariances,0,sizeof(context->canonicalVariances));
+    if(context->options.mode==EXACT_MODE || context->options.mode==TABLE_MODE)
+    { getExactProbabilities(context);
+    }
+    else if(context->options.mode==HOLDEM_MODE) getRiverProbabilities(context);
+    else getSampledProbabilities(context);
+    storeCache(context,context->canonicalMask,context->canonicalDead);
+    for(i=0; i<HAND_SIZE; ++i) context->evaluations+=context->canonicalSamplesDrawn[i];
+  }
+}
+/************************************************************************
+* canonicalizeHand relabels the suits of a hand so that the 13 bit suit
+* fields run from the largest field value down. Every suit permutation
+* of a hand gives the same fields in some order, so they all come out
+* as one mask: 134,459 classes instead of 2,598,960 hands. Equal fields
+* are interchangeable, so it does not matter which one goes first. With
+* dead cards two suits are only interchangeable when their dead cards
+* match too, so the dead field breaks ties between equal hand fields.
+*
+* Returns the canonical mask, map[] gets the canonical suit of every
+* suit of mask
+**************************************************************************/
+static uint64_t canonicalizeHand(uint64_t mask, uint64_t dead, int map[])
+{ int order[SUIT_COUNT], i, j, suit;
+  uint64_t canonical=0;
+  //Insertion sort of the suits by field, largest first
+  for(i=0; i<SUIT_COUNT; ++i)
+  { suit=i;
+    for(j=i; j>0 && (SUIT_RANKS(mask,order[j-1])<<RANK_COUNT | SUIT_RANKS(dead,order[j-1]))
+                    <(SUIT_RANKS(mask,suit)<<RANK_COUNT | SUIT_RANKS(dead,suit)); --j)
+    { order[j]=order[j-1];
+    }
+    order[j]=suit;
+  }
+  for(i=0; i<SUIT_COUNT; ++i)
+  { map[order[i]]=i;
+    canonical|=(uint64_t)SUIT_RANKS(mask,order[i])<<(i*RANK_COUNT);
+  }
+  return canonical;
+}
+/************************************************************************
+* mapSuits moves every suit field of mask to the suit map[] gives it
+*
+* Returns the relabelled mask
+**************************************************************************/
+static uint64_t mapSuits(uint64_t mask, const int map[])
+{ uint64_t mapped=0;
+  int suit;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { mapped|=(uint64_t)SUIT_RANKS(mask,suit)<<(map[suit]*RANK_COUNT);
+  }
+  return mapped;
+}
+/************************************************************************
+* placeProbabilities turns the result of every card of canonicalMask into
+* a percentage in the slot of the input card it came from, so the
+* probabilities of result always line up with the cards of hand. The
+* effective samples are the independent draws p(1-p)/n that would give
+* the same variance, so they show what the sampling method gained.
+*
+* No returns, fills probabilities[], samplesDrawn[], variances[] and
+* effectiveSamples[] of result, and with histogram the histograms
+**************************************************************************/
+static void placeProbabilities(const PokerContext *context, const PokerHand *hand,
+                               PokerResult *result)
+{ int i, slot, card;
+  uint64_t bit;
+  double p;
+  for(i=0; i<HAND_SIZE; ++i)
+  { card=hand->cards[i];
+    bit=CARD_BIT(card%RANK_COUNT,context->suitMap[card/RANK_COUNT]);
+    slot=POPCOUNT(context->canonicalMask & (bit-1));
+    result->samplesDrawn[i]=context->canonicalSamplesDrawn[slot];
+    result->probabilities[i]=100*((float)context->canonicalImprovements[slot]
+                                  /result->samplesDrawn[i]);
+    p=(double)context->canonicalImprovements[slot]/result->samplesDrawn[i];
+    result->variances[i]=context->canonicalVariances[slot];
+    result->effectiveSamples[i]=(result->variances[i]>0) ? p*(1-p)/result->variances[i]
+                                                          : result->samplesDrawn[i];
+    if(context->options.histogram==TRUE) placeHistogram(context,slot,i,result);
+  }
+}
+/************************************************************************
+* placeHistogram turns the major rank counts and score sum of canonical
+* slot into percentages and a mean score at place of the input order
+*
+* No returns, fills categoryProbabilities[place][] and
+* expectedScores[place] of result
+**************************************************************************/
+static void placeHistogram(const PokerContext *context, int slot, int place, PokerResult *result)
+{ double percent=100.0/result->samplesDrawn[place];
+  int category;
+  for(category=0; category<CATEGORY_COUNT; ++category)
+  { result->categoryProbabilities[place][category]
+      =context->canonicalCategories[slot][category]*percent;
+  }
+  result->expectedScores[place]=(double)context->canonicalScoreSums[slot]/result->samplesDrawn[place];
+}
+/************************************************************************
+* startCache sizes the probability cache to fit in cacheMegabytes, with
+* a power of two bucket count about twice the number of entries so the
+* chains stay short. A size of 0 turns the cache off.
+*
+* Returns TRUE, or FALSE if the memory could not be had
+**************************************************************************/
+static int startCache(PokerContext *context)
+{ size_t bytes=(size_t)context->options.cacheMegabytes<<20;
+  size_t entryBytes=sizeof(CacheEntry)+2*sizeof(int);
+  int i;
+  if(context->options.histogram==TRUE) entryBytes+=sizeof(CacheOutcome);
+  context->cacheCapacity=(int)MIN(bytes/entryBytes,MAX_CACHE_ENTRIES);
+  if(context->cacheCapacity==0) return TRUE;
+  for(context->cacheBucketCount=1; context->cacheBucketCount<context->cacheCapacity;
+      context->cacheBucketCount<<=1);
+  context->cacheEntries=malloc(context->cacheCapacity*sizeof(CacheEntry));
+  context->cacheBuckets=malloc(context->cacheBucketCount*sizeof(int));
+  if(context->options.histogram==TRUE)
+  { context->cacheOutcomes=malloc(context->cacheCapacity*sizeof(CacheOutcome));
+  }
+  if(context->cacheEntries==NULL || context->cacheBuckets==NULL
+     || (context->options.histogram==TRUE && context->cacheOutcomes==NULL))
+  { stopCache(context);
+    return FALSE;
+  }
+  for(i=0; i<context->cacheBucketCount; ++i) context->cacheBuckets[i]=CACHE_EMPTY;
+  return TRUE;
+}
+/************************************************************************
+* stopCache frees the probability cache
+**************************************************************************/
+static void stopCache(PokerContext *context)
+{ free(context->cacheEntries);
+  free(context->cacheOutcomes);
+  free(context->cacheBuckets);
+  context->cacheEntries=NULL;
+  context->cacheOutcomes=NULL;
+  context->cacheBuckets=NULL;
+  context->cacheCapacity=0;
+}
+/************************************************************************
+* cacheBucket hashes a canonical hand and its dead cards to a bucket.
+* The multiply spreads the card bits over the top of the word, which the
+* shift keeps.
+**************************************************************************/
+static int cacheBucket(const PokerContext *context, uint64_t mask, uint64_t dead)
+{ return (int)(((mask ^ dead*0xC2B2AE3D27D4EB4FULL)*0x9E3779B97F4A7C15ULL)>>32)
+         & (context->cacheBucketCount-1);
+}
+/************************************************************************
+* lookupCache finds the results of a canonical hand with the given dead
+* cards and marks the entry as recently used for the CLOCK sweep.
+*
+* Returns the entry, or NULL if the hand is not cached
+**************************************************************************/
+static CacheEntry *lookupCache(PokerContext *context, uint64_t mask, uint64_t dead)
+{ CacheEntry *entries=context->cacheEntries;
+  int index;
+  if(context->cacheCapacity==0) return NULL;
+  for(index=context->cacheBuckets[cacheBucket(context,mask,dead)]; index!=CACHE_EMPTY;
+      index=entries[index].next)
+  { if(entries[index].mask==mask && entries[index].dead==dead)
+    { entries[index].referenced=TRUE;
+      ++context->cacheHits;
+      return &entries[index];
+    }
+  }
+  ++context->cacheMisses;
+  return NULL;
+}
+/************************************************************************
+* storeCache saves canonicalImprovements and canonicalSamplesDrawn for a
+* canonical hand, and its histogram in the outcome of the same index. Once the cache is full the CLOCK hand sweeps the
+* entries, giving every recently used one a second chance, and reuses
+* the first entry that has not been looked up since the last sweep.
+*
+* No returns, takes the canonical hand and dead cards the results
+* belong to
+**************************************************************************/
+static void storeCache(PokerContext *context, uint64_t mask, uint64_t dead)
+{ CacheEntry *entries=context->cacheEntries, *entry;
+  int index, i, *link;
+  if(context->cacheCapacity==0) return;
+  if(context->cacheUsed<context->cacheCapacity) index=context->cacheUsed++;
+  else
+  { while(entries[context->cacheClock].referenced==TRUE)
+    { entries[context->cacheClock].referenced=FALSE;
+      context->cacheClock=(context->cacheClock+1)%context->cacheCapacity;
+    }
+    index=context->cacheClock;
+    context->cacheClock=(context->cacheClock+1)%context->cacheCapacity;
+    //Unlink the victim from its chain
+    for(link=&context->cacheBuckets[cacheBucket(context,entries[index].mask,
+                                                entries[index].dead)];
+        *link!=index; link=&entries[*link].next);
+    *link=entries[index].next;
+    ++context->cacheEvictions;
+  }
+  entry=&entries[index];
+  entry->mask=mask;
+  entry->dead=dead;
+  memcpy(entry->improvements,context->canonicalImprovements,sizeof(entry->improvements));
+  memcpy(entry->samplesDrawn,context->canonicalSamplesDrawn,sizeof(entry->samplesDrawn));
+  for(i=0; i<HAND_SIZE; ++i) entry->variances[i]=(float)context->canonicalVariances[i];
+  if(context->options.histogram==TRUE)
+  { memcpy(context->cacheOutcomes[index].categories,context->canonicalCategories,
+           sizeof(context->canonicalCategories));
+    memcpy(context->cacheOutcomes[index].scoreSums,context->canonicalScoreSums,
+           sizeof(context->canonicalScoreSums));
+  }
+  entry->referenced=FALSE;
+  entry->next=context->cacheBuckets[cacheBucket(context,mask,dead)];
+  context->cacheBuckets[cacheBucket(context,mask,dead)]=index;
+}
+/************************************************************************
+* tableIndex ranks a hand among all C(DECK_SIZE,HAND_SIZE) hands in
+* colexicographic order: the sum over its cards, lowest first, of
+* binomial[bit][place+1]. It is one popcount-free loop over five bits.
+*
+* Returns the index, takes a mask of exactly HAND_SIZE cards
+**************************************************************************/
+static int tableIndex(uint64_t mask)
+{ int i, index=0;
+  for(i=1; i<=HAND_SIZE; ++i, mask&=mask-1)
+  { index+=binomial[__builtin_ctzll(mask)][i];
+  }
+  return index;
+}
+/************************************************************************
+* buildBinomials fills binomial[n][k] for the table index
+*
+* No returns no parameters
+**************************************************************************/
+static void buildBinomials(void)
+{ int n, k;
+  for(n=0; n<=DECK_SIZE; ++n)
+  { binomial[n][0]=1;
+    for(k=1; k<=HAND_SIZE; ++k)
+    { binomial[n][k]=(n==0) ? 0 : binomial[n-1][k-1]+binomial[n-1][k];
+    }
+  }
+}
+/************************************************************************
+* pokerGenerateTable works out the exact improvements of every hand and
+* writes them to file: a TableHeader and then HAND_SIZE counts per hand,
+* in tableIndex order, one per card of the hand lowest bit first. Each
+* count is out of the DECK_SIZE-HAND_SIZE cards left. The context has
+* to be in EXACT_MODE, a table of sampled counts would not be exact.
+*
+* Returns POKER_OK or an error code
+**************************************************************************/
+int pokerGenerateTable(PokerContext *context, const char *file)
+{ TableHeader header;
+  uint8_t *counts;
+  int error;
+  if(context->options.mode!=EXACT_MODE) return POKER_BAD_OPTIONS;
+  if((counts=malloc((size_t)TABLE_HAND_COUNT*HAND_SIZE))==NULL) return POKER_NO_MEMORY;
+  generateCounts(context,0,TABLE_HAND_COUNT,counts);
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,TABLE_MAGIC,sizeof(header.magic));
+  header.version=TABLE_VERSION;
+  header.handSize=HAND_SIZE;
+  header.deckSize=DECK_SIZE;
+  header.handCount=TABLE_HAND_COUNT;
+  header.checksum=checksumCounts(CHECKSUM_SEED,counts,(size_t)TABLE_HAND_COUNT*HAND_SIZE);
+  error=writeTableFile(file,&header,sizeof(header),counts,TABLE_HAND_COUNT);
+  free(counts);
+  return error;
+}
+/************************************************************************
+* pokerGenerateTableShard writes shard of shardCount of the table, so
+* the table can be generated on shardCount nodes at once. The shards
+* split the tableIndex range into contiguous runs in shard order, and a
+* shard file is a ShardHeader and the counts of its run exactly as the
+* full table holds them, so pokerMergeTables only has to concatenate
+* them.
+*
+* Returns POKER_OK or an error code
+**************************************************************************/
+int pokerGenerateTableShard(PokerContext *context, const char *file, int shard, int shardCount)
+{ ShardHeader header;
+  uint8_t *counts;
+  int first, count, error;
+  if(context->options.mode!=EXACT_MODE || shardCount<1 || shardCount>TABLE_HAND_COUNT
+     || shard<0 || shard>=shardCount) return POKER_BAD_OPTIONS;
+  first=(int)((uint64_t)shard*TABLE_HAND_COUNT/shardCount);
+  count=(int)((uint64_t)(shard+1)*TABLE_HAND_COUNT/shardCount)-first;
+  if((counts=malloc((size_t)count*HAND_SIZE))==NULL) return POKER_NO_MEMORY;
+  generateCounts(context,first,count,counts);
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,SHARD_MAGIC,sizeof(header.magic));
+  header.version=TABLE_VERSION;
+  header.handSize=HAND_SIZE;
+  header.deckSize=DECK_SIZE;
+  header.shardIndex=shard;
+  header.shardCount=shardCount;
+  header.firstHand=first;
+  header.handCount=count;
+  header.checksum=checksumCounts(CHECKSUM_SEED,counts,(size_t)count*HAND_SIZE);
+  error=writeTableFile(file,&header,sizeof(header),counts,count);
+  free(counts);
+  return error;
+}
+/************************************************************************
+* generateCounts works out the counts of count hands from tableIndex
+* first on. Hands come out of nextCombination in tableIndex order, so
+* only the first one is looked up. Only the canonical hands are
+* evaluated, the cache hands the rest their results.
+*
+* No returns, fills count*HAND_SIZE counts
+**************************************************************************/
+static void generateCounts(PokerContext *context, int first, int count, uint8_t counts[])
+{ uint64_t mask, cards, bit;
+  int cardBits[HAND_SIZE], i, index;
+  handAtIndex(first,cardBits);
+  for(index=0; index<count; ++index, nextCombination(cardBits,HAND_SIZE,DECK_SIZE))
+  { for(mask=0, i=0; i<HAND_SIZE; ++i) mask|=(uint64_t)1<<cardBits[i];
+    context->handMask=mask;
+    context->handScore=pokerGetHandRank(mask);
+    context->canonicalMask=canonicalizeHand(mask,0,context->suitMap);
+    context->canonicalDead=0;
+    getCanonicalProbabilities(context);
+    for(cards=mask, i=0; i<HAND_SIZE; ++i, cards&=cards-1)
+    { bit=CARD_BIT(__builtin_ctzll(cards)%RANK_COUNT,
+                   context->suitMap[__builtin_ctzll(cards)/RANK_COUNT]);
+      counts[(size_t)index*HAND_SIZE+i]
+        =context->canonicalImprovements[POPCOUNT(context->canonicalMask & (bit-1))];
+    }
+  }
+}
+/************************************************************************
+* writeTableFile writes a header and the counts of handCount hands
+*
+* Returns POKER_OK or POKER_TABLE_UNWRITABLE
+**************************************************************************/
+static int writeTableFile(const char *file, const void *header, size_t headerSize,
+                          const uint8_t counts[], int handCount)
+{ FILE *stream;
+  if((stream=fopen(file,"wb"))==NULL) return POKER_TABLE_UNWRITABLE;
+  if(fwrite(header,headerSize,1,stream)!=1
+     || fwrite(counts,HAND_SIZE,handCount,stream)!=(size_t)handCount)
+  { fclose(stream);
+    return POKER_TABLE_UNWRITABLE;
+  }
+  return (fclose(stream)==0) ? POKER_OK : POKER_TABLE_UNWRITABLE;
+}
+/************************************************************************
+* pokerMergeTables joins shard files written by pokerGenerateTableShard
+* into a table file. Every header is checked before anything is written:
+* the shards have to come from one split, each shard once, and their
+* runs have to cover every hand without a gap or overlap. The shards are
+* then streamed into the table in hand order, whatever order they are
+* given in, and each one's checksum is checked as it goes by. The table
+* is written under a temporary name and only renamed to file once all
+* of it checked out.
+*
+* Returns POKER_OK or an error code, *badShard gets the place in
+* shards[] of the file at fault or -1
+**************************************************************************/
+int pokerMergeTables(const char *file, const char *shards[], int shardCount, int *badShard)
+{ ShardHeader *headers;
+  TableHeader header;
+  int *order, i, error=POKER_OK;
+  uint64_t nextHand=0;
+  char *temporary;
+  FILE *output=NULL;
+  *badShard=-1;
+  if(shardCount<1) return POKER_SHARD_MISMATCH;
+  headers=malloc(shardCount*sizeof(ShardHeader));
+  order=malloc(shardCount*sizeof(int));
+  temporary=malloc(strlen(file)+sizeof(".partial"));
+  if(headers==NULL || order==NULL || temporary==NULL) error=POKER_NO_MEMORY;
+  for(i=0; i<shardCount && error==POKER_OK; ++i)
+  { if((error=readShardHeader(shards[i],&headers[i]))!=POKER_OK) *badShard=i;
+    else if(headers[i].shardCount!=(uint32_t)shardCount
+            || headers[i].shardCount!=headers[0].shardCount)
+    { error=POKER_SHARD_MISMATCH;
+      *badShard=i;
+    }
+  }
+  //Place every shard by its index, a missing or repeated index is a gap
+  for(i=0; i<shardCount && error==POKER_OK; ++i) order[i]=-1;
+  for(i=0; i<shardCount && error==POKER_OK; ++i)
+  { if(order[headers[i].shardIndex]>=0)
+    { error=POKER_SHARD_MISMATCH;
+      *badShard=i;
+    }
+    else order[headers[i].shardIndex]=i;
+  }
+  for(i=0; i<shardCount && error==POKER_OK; ++i)
+  { if(headers[order[i]].firstHand!=nextHand)
+    { error=POKER_SHARD_MISMATCH;
+      *badShard=order[i];
+    }
+    nextHand+=headers[order[i]].handCount;
+  }
+  if(error==POKER_OK && nextHand!=TABLE_HAND_COUNT) error=POKER_SHARD_MISMATCH;
+  if(error==POKER_OK)
+  { sprintf(temporary,"%s.partial",file);
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,TABLE_MAGIC,sizeof(header.magic));
+    header.version=TABLE_VERSION;
+    header.handSize=HAND_SIZE;
+    header.deckSize=DECK_SIZE;
+    header.handCount=TABLE_HAND_COUNT;
+    header.checksum=CHECKSUM_SEED;
+    if((output=fopen(temporary,"wb"))==NULL
+       || fwrite(&header,sizeof(header),1,output)!=1) error=POKER_TABLE_UNWRITABLE;
+  }
+  for(i=0; i<shardCount && error==POKER_OK; ++i)
+  { if((error=copyShard(shards[order[i]],&headers[order[i]],output,&header.checksum))
+       !=POKER_OK)
+    { *badShard=order[i];
+    }
+  }
+  //The checksum of the whole table is only known once every shard is in
+  if(error==POKER_OK && (fseek(output,0,SEEK_SET)!=0
+                         || fwrite(&header,sizeof(header),1,output)!=1))
+  { error=POKER_TABLE_UNWRITABLE;
+  }
+  if(output!=NULL && fclose(output)!=0 && error==POKER_OK) error=POKER_TABLE_UNWRITABLE;
+  if(output!=NULL && error==POKER_OK && rename(temporary,file)!=0) error=POKER_TABLE_UNWRITABLE;
+  if(output!=NULL && error!=POKER_OK) remove(temporary);
+  free(headers);
+  free(order);
+  free(temporary);
+  return error;
+}
+/************************************************************************
+* readShardHeader reads and checks the header of a shard file, and
+* that the file holds exactly the counts the header promises
+*
+* Returns POKER_OK or an error code
+**************************************************************************/
+static int readShardHeader(const char *file, ShardHeader *header)
+{ struct stat status;
+  FILE *stream;
+  int valid;
+  if((stream=fopen(file,"rb"))==NULL) return POKER_TABLE_UNREADABLE;
+  valid=fstat(fileno(stream),&status)==0 && fread(header,sizeof(*header),1,stream)==1;
+  fclose(stream);
+  if(valid==FALSE
+     || memcmp(header->magic,SHARD_MAGIC,sizeof(header->magic))!=0
+     || header->version!=TABLE_VERSION || header->handSize!=HAND_SIZE
+     || header->deckSize!=DECK_SIZE || header->shardIndex>=header->shardCount
+     || header->handCount>TABLE_HAND_COUNT
+     || (uint64_t)status.st_size!=sizeof(*header)+header->handCount*HAND_SIZE)
+  { return POKER_TABLE_INVALID;
+  }
+  return POKER_OK;
+}
+/************************************************************************
+* copyShard streams the counts of a shard into the merged table a block
+* at a time and checks the shard's checksum on the way. The blocks are
+* also carried into *tableChecksum, the checksum of the merged counts.
+*
+* Returns POKER_OK or an error code
+**************************************************************************/
+static int copyShard(const char *file, const ShardHeader *header, FILE *output,
+                     uint64_t *tableChecksum)
+{ uint8_t block[MERGE_BLOCK_SIZE];
+  uint64_t left=header->handCount*HAND_SIZE, checksum=CHECKSUM_SEED;
+  size_t length;
+  FILE *stream;
+  int error=POKER_OK;
+  if((stream=fopen(file,"rb"))==NULL || fseek(stream,sizeof(*header),SEEK_SET)!=0)
+  { if(stream!=NULL) fclose(stream);
+    return POKER_TABLE_UNREADABLE;
+  }
+  while(left>0 && error==POKER_OK)
+  { length=MIN(left,sizeof(block));
+    if(fread(block,1,length,stream)!=length) error=POKER_TABLE_UNREADABLE;
+    else if(fwrite(block,1,length,output)!=length) error=POKER_TABLE_UNWRITABLE;
+    checksum=checksumCounts(checksum,block,length);
+    *tableChecksum=checksumCounts(*tableChecksum,block,length);
+    left-=length;
+  }
+  fclose(stream);
+  if(error==POKER_OK && checksum!=header->checksum) error=POKER_CHECKSUM_MISMATCH;
+  return error;
+}
+/************************************************************************
+* checksumCounts carries a 64 bit FNV-1a hash over more counts, so a
+* shard can be hashed whole or a block at a time with the same result
+*
+* Returns the hash so far, takes the hash of what came before
+**************************************************************************/
+static uint64_t checksumCounts(uint64_t hash, const uint8_t counts[], size_t length)
+{ size_t i;
+  for(i=0; i<length; ++i) hash=(hash^counts[i])*0x100000001B3ULL;
+  return hash;
+}
+/************************************************************************
+* handAtIndex is the inverse of tableIndex: working down from the top
+* card, each card is the highest bit whose binomial still fits in what
+* is left of the index.
+*
+* No returns, fills cardBits[] with the cards of the hand, lowest first
+**************************************************************************/
+static void handAtIndex(int index, int cardBits[])
+{ int i, bit;
+  for(i=HAND_SIZE-1; i>=0; --i)
+  { bit=DECK_SIZE-1;
+    while(binomial[bit][i+1]>index) --bit;
+    cardBits[i]=bit;
+    index-=binomial[bit][i+1];
+  }
+}
+/************************************************************************
+* nextCombination steps size ascending card bits below limit to the
+* next hand, moving the lowest card that can go up and resetting the
+* ones below it.
+*
+* Returns TRUE, or FALSE after the last hand
+**************************************************************************/
+static int nextCombination(int cardBits[], int size, int limit)
+{ int i, j;
+  for(i=0; i<size; ++i)
+  { if(cardBits[i]+1<((i+1<size) ? cardBits[i+1] : limit))
+    { ++cardBits[i];
+      for(j=0; j<i; ++j) cardBits[j]=j;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+/************************************************************************
+* mapTable maps a table file into memory read only and checks its size
+* and header. Pages are only read in as hands touch them, so this does
+* no I/O beyond the header.
+*
+* Returns POKER_OK with *map set to the whole file, or the error code
+* of why the table cannot be used
+**************************************************************************/
+static int mapTable(const char *file, const TableHeader **map)
+{ struct stat status;
+  void *mapped;
+  int descriptor;
+  size_t size=sizeof(TableHeader)+(size_t)TABLE_HAND_COUNT*HAND_SIZE;
+  if((descriptor=open(file,O_RDONLY))<0 || fstat(descriptor,&status)!=0)
+  { if(descriptor>=0) close(descriptor);
+    return POKER_TABLE_UNREADABLE;
+  }
+  if((size_t)status.st_size!=size
+     || (mapped=mmap(NULL,size,PROT_READ,MAP_SHARED,descriptor,0))==MAP_FAILED)
+  { close(descriptor);
+    return POKER_TABLE_INVALID;
+  }
+  close(descriptor);
+  *map=mapped;
+  if(memcmp((*map)->magic,TABLE_MAGIC,sizeof((*map)->magic))!=0
+     || (*map)->version!=TABLE_VERSION || (*map)->handSize!=HAND_SIZE
+     || (*map)->deckSize!=DECK_SIZE || (*map)->handCount!=TABLE_HAND_COUNT)
+  { munmap(mapped,size);
+    return POKER_TABLE_INVALID;
+  }
+  return POKER_OK;
+}
+/************************************************************************
+* openTable maps the table file of the options with mapTable. The
+* counts are not read here, getTableProbabilities checks the ones a
+* hand looks up and pokerVerifyTable checks the whole file.
+*
+* Returns POKER_OK, or the error code of why the table cannot be used
+**************************************************************************/
+static int openTable(PokerContext *context)
+{ const TableHeader *map;
+  int error;
+  if((error=mapTable(context->options.tableFile,&map))!=POKER_OK) return error;
+  context->tableMap=(void *)map;
+  context->tableSize=sizeof(TableHeader)+(size_t)TABLE_HAND_COUNT*HAND_SIZE;
+  context->tableCounts=(const uint8_t *)map+sizeof(TableHeader);
+  return POKER_OK;
+}
+/************************************************************************
+* pokerVerifyTable reads every count of a table file once, for the
+* checksum of its header and to refuse a count above the
+* DECK_SIZE-HAND_SIZE cards a discard can be replaced by. It reads all
+* 13 MB, so it is a check to run once on a new or copied table, not on
+* every open.
+*
+* Returns POKER_OK, or the error code of what is wrong with the table
+**************************************************************************/
+int pokerVerifyTable(const char *file)
+{ const TableHeader *map;
+  const uint8_t *counts;
+  size_t length=(size_t)TABLE_HAND_COUNT*HAND_SIZE, i;
+  uint8_t largest=0;
+  int error;
+  if((error=mapTable(file,&map))!=POKER_OK) return error;
+  counts=(const uint8_t *)map+sizeof(TableHeader);
+  madvise((void *)map,sizeof(TableHeader)+length,MADV_SEQUENTIAL);
+  for(i=0; i<length; ++i) largest=MAX(largest,counts[i]);
+  if(largest>DECK_SIZE-HAND_SIZE) error=POKER_TABLE_INVALID;
+  else if(checksumCounts(CHECKSUM_SEED,counts,length)!=map->checksum)
+  { error=POKER_CHECKSUM_MISMATCH;
+  }
+  munmap((void *)map,sizeof(TableHeader)+length);
+  return error;
+}
+/************************************************************************
+* Table version of getProbabilities, reads the counts of the hand
+* straight out of the mapped table and evaluates nothing. openTable
+* does not read the counts, so a count above DECK_SIZE-HAND_SIZE, from
+* a corrupted table, is refused here instead of printing over 100%.
+*
+* Returns TRUE, or FALSE for a bad count with result left for the
+* exact method, fills probabilities[] and samplesDrawn[] of result
+**************************************************************************/
+static int getTableProbabilities(const PokerContext *context, const PokerHand *hand,
+                                 PokerResult *result)
+{ const uint8_t *counts=context->tableCounts+(size_t)tableIndex(context->handMask)*HAND_SIZE;
+  int i;
+  uint64_t bit;
+  for(i=0; i<HAND_SIZE; ++i)
+  { if(counts[i]>DECK_SIZE-HAND_SIZE) return FALSE;
+  }
+  for(i=0; i<HAND_SIZE; ++i)
+  { bit=(uint64_t)1<<hand->cards[i];
+    result->samplesDrawn[i]=DECK_SIZE-HAND_SIZE;
+    result->probabilities[i]=100*((float)counts[POPCOUNT(context->handMask & (bit-1))]
+                                  /result->samplesDrawn[i]);
+  }
+  return TRUE;
+}
+/************************************************************************
+* Exact version of getProbabilities. Only DECK_SIZE-HAND_SIZE cards can
+* replace a discard, so each of them is drawn exactly once instead of
+* sampling, which is 235 evaluations per hand rather than millions.
+* The candidates come from remainingDeck, which already leaves out the
+* discarded card, and countImprovements takes them a vector at a time.
+* With histogram countOutcomes does the same pass and also sorts the
+* scores by major rank.
+*
+* No returns, results go into canonicalImprovements[],
+* canonicalSamplesDrawn[] and with histogram canonicalCategories[][]
+* and canonicalScoreSums[]
+**************************************************************************/
+static void getExactProbabilities(PokerContext *context)
+{ int i;
+  uint64_t keptMask, cards=context->canonicalMask;
+  buildCandidates(context);
+  //Loop over possible cards to discard, lowest bit first
+  for(i=0; i<HAND_SIZE; ++i, cards&=cards-1)
+  { keptMask=context->canonicalMask & ~(cards & -cards);
+    if(context->options.histogram==TRUE)
+    { context->canonicalImprovements[i]=kernel->countOutcomes(&context->candidates,keptMask,
+                                                              context->handScore,
+                                                              context->canonicalCategories[i],
+                                                              &context->canonicalScoreSums[i]);
+    }
+    else context->canonicalImprovements[i]=kernel->countImprovements(&context->candidates,
+                                                                     keptMask,context->handScore);
+    context->canonicalSamplesDrawn[i]=context->remainingCount;
+  }
+}
+/************************************************************************
+* getRiverProbabilities deals canonicalMask every board it can still get
+* by the river, one or two cards, and counts the boards whose best five
+* cards beat handScore. A board only adds its cards' SEVEN_RANK_KEY to
+* the rank key of the hand and its cards' bits to the fields of their
+* suits, so each board is one sevenRankTable load and a flushTable load
+* per suit it touches. The best flush already held covers the rest.
+*
+* No returns, fills canonicalImprovements[0] and canonicalSamplesDrawn[0]
+**************************************************************************/
+static void getRiverProbabilities(PokerContext *context)
+{ uint64_t mask=context->canonicalMask;
+  int fields[SUIT_COUNT], key=0, heldFlush=0, improvements=0, boards=0;
+  int cardsLeft, i, j, first, second, firstSuit, secondSuit, firstField, secondField, score;
+  for(i=0; i<SUIT_COUNT; ++i)
+  { fields[i]=SUIT_RANKS(mask,i);
+    key+=suitSevenKey[fields[i]];
+    heldFlush=MAX(heldFlush,flushTable[fields[i]]);
+  }
+  cardsLeft=MAX_HAND_CARDS-POPCOUNT(mask);
+  for(i=0; i<context->remainingCount && cardsLeft>0; ++i)
+  { first=__builtin_ctzll(context->remainingDeck[i]);
+    firstSuit=first/RANK_COUNT;
+    if(cardsLeft==1)
+    { score=MAX(sevenRankTable[key+SEVEN_RANK_KEY[first%RANK_COUNT]],
+                MAX(heldFlush,flushTable[fields[firstSuit] | 1<<(first%RANK_COUNT)]));
+      improvements+=(score>context->handScore);
+      ++boards;
+      continue;
+    }
+    for(j=i+1; j<context->remainingCount; ++j)
+    { second=__builtin_ctzll(context->remainingDeck[j]);
+      secondSuit=second/RANK_COUNT;
+      firstField=fields[firstSuit] | 1<<(first%RANK_COUNT);
+      secondField=fields[secondSuit] | 1<<(second%RANK_COUNT);
+      if(firstSuit==secondSuit) firstField=secondField=firstField|secondField;
+      score=MAX(sevenRankTable[key+SEVEN_RANK_KEY[first%RANK_COUNT]+SEVEN_RANK_KEY[second%RANK_COUNT]],
+                MAX(heldFlush,MAX(flushTable[firstField],flushTable[secondField])));
+      improvements+=(score>context->handScore);
+      ++boards;
+    }
+  }
+  memset(context->canonicalImprovements,0,sizeof(context->canonicalImprovements));
+  memset(context->canonicalSamplesDrawn,0,sizeof(context->canonicalSamplesDrawn));
+  context->canonicalImprovements[0]=improvements;
+  context->canonicalSamplesDrawn[0]=boards;
+}
+/************************************************************************
+* placeRiverProbabilities turns the board counts of getRiverProbabilities
+* into the river fields of result. They belong to the hand as a whole,
+* so nothing has to be carried back to the input order. A full board
+* has nothing left to deal and improves 0% of the time.
+*
+* No returns, fills riverImprovement and riverBoards of result
+**************************************************************************/
+static void placeRiverProbabilities(const PokerContext *context, PokerResult *result)
+{ result->riverBoards=context->canonicalSamplesDrawn[0];
+  result->riverImprovement=(result->riverBoards>0)
+                           ? 100.0*context->canonicalImprovements[0]/result->riverBoards : 0;
+}
+/************************************************************************
+* buildCandidates splits the cards of remainingDeck into the parts
+* countImprovements adds to a kept hand: the card's RANK_KEY, its suit
+* and its bit inside the suit field. Lanes past remainingCount are left
+* as card 0 so a full vector can always be loaded.
+*
+* No returns, fills the candidates of the context
+**************************************************************************/
+static void buildCandidates(PokerContext *context)
+{ CandidateDeck *candidates=&context->candidates;
+  int j, bit;
+  memset(candidates,0,sizeof(*candidates));
+  for(j=0; j<context->remainingCount; ++j)
+  { bit=__builtin_ctzll(context->remainingDeck[j]);
+    candidates->rankKey[j]=RANK_KEY[bit%RANK_COUNT];
+    candidates->suit[j]=bit/RANK_COUNT;
+    candidates->rankBit[j]=1<<(bit%RANK_COUNT);
+  }
+  candidates->count=context->remainingCount;
+}
+/************************************************************************
+* countImprovements evaluates the kept hand with every candidate card
+* added and counts the hands that beat score. Adding a card adds its
+* RANK_KEY to the kept hand's rank key and its bit to one suit field, so
+* each candidate is one add, one or, and two table loads, with the same
+* max as pokerEvaluateHand. This is the scalar kernel, one card at a
+* time, which every target can run: SSE4.1 and NEON have no gather.
+*
+* Returns the number of candidates that improve on score
+**************************************************************************/
+static int countImprovements(const CandidateDeck *candidates, uint64_t keptMask, int score)
+{ int fields[SUIT_COUNT], keptKey=0, suit, j, count=0;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { fields[suit]=SUIT_RANKS(keptMask,suit);
+    keptKey+=suitRankKey[fields[suit]];
+  }
+  for(j=0; j<candidates->count; ++j)
+  { count+=MAX(rankTable[keptKey+candidates->rankKey[j]],
+               flushTable[fields[candidates->suit[j]] | candidates->rankBit[j]])>score;
+  }
+  return count;
+}
+/************************************************************************
+* countOutcomes is countImprovements that also counts the candidates by
+* the major rank they end on, a load from scoreCategory, and adds up
+* their scores. Scalar kernel.
+*
+* Returns the number of candidates that improve on score, fills
+* categories[] by category-HIGH_CARD and the sum of the scores
+**************************************************************************/
+static int countOutcomes(const CandidateDeck *candidates, uint64_t keptMask, int score,
+                         int categories[], uint64_t *scoreSum)
+{ int fields[SUIT_COUNT], keptKey=0, suit, j, count=0, candidateScore;
+  uint64_t sum=0;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { fields[suit]=SUIT_RANKS(keptMask,suit);
+    keptKey+=suitRankKey[fields[suit]];
+  }
+  memset(categories,0,CATEGORY_COUNT*sizeof(int));
+  for(j=0; j<candidates->count; ++j)
+  { candidateScore=MAX(rankTable[keptKey+candidates->rankKey[j]],
+                       flushTable[fields[candidates->suit[j]] | candidates->rankBit[j]]);
+    count+=candidateScore>score;
+    sum+=candidateScore;
+    ++categories[scoreCategory[candidateScore]-HIGH_CARD];
+  }
+  *scoreSum=sum;
+  return count;
+}
+#if defined(X86_KERNELS)
+/************************************************************************
+* countImprovementsAvx2 is the AVX2 kernel of countImprovements, eight
+* candidates at once with the two loads being gathers
+*
+* Returns the number of candidates that improve on score
+**************************************************************************/
+static AVX2_TARGET int countImprovementsAvx2(const CandidateDeck *candidates, uint64_t keptMask,
+                                             int score)
+{ int fields[SUIT_COUNT], keptKey=0, suit, j, count=0;
+  __m256i suitFields, baseKey, scores, lanes, low16, key, field, rankScore, flushScore, better;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { fields[suit]=SUIT_RANKS(keptMask,suit);
+    keptKey+=suitRankKey[fields[suit]];
+  }
+  suitFields=_mm256_setr_epi32(fields[0],fields[1],fields[2],fields[3],0,0,0,0);
+  baseKey=_mm256_set1_epi32(keptKey);
+  scores=_mm256_set1_epi32(score);
+  lanes=_mm256_setr_epi32(0,1,2,3,4,5,6,7);
+  low16=_mm256_set1_epi32(0xFFFF);
+  for(j=0; j<candidates->count; j+=CANDIDATE_LANES)
+  { key=_mm256_add_epi32(baseKey,_mm256_loadu_si256((const __m256i *)&candidates->rankKey[j]));
+    field=_mm256_or_si256(_mm256_permutevar8x32_epi32(suitFields,
+            _mm256_loadu_si256((const __m256i *)&candidates->suit[j])),
+            _mm256_loadu_si256((const __m256i *)&candidates->rankBit[j]));
+    //Gathers read 32 bits at every 16 bit entry, the high half is masked away
+    rankScore=_mm256_and_si256(_mm256_i32gather_epi32((const int *)rankTable,key,2),low16);
+    flushScore=_mm256_and_si256(_mm256_i32gather_epi32((const int *)flushTable,field,2),low16);
+    better=_mm256_and_si256(_mm256_cmpgt_epi32(_mm256_max_epi32(rankScore,flushScore),scores),
+                            _mm256_cmpgt_epi32(_mm256_set1_epi32(candidates->count-j),lanes));
+    count+=POPCOUNT(_mm256_movemask_ps(_mm256_castsi256_ps(better)));
+  }
+  return count;
+}
+/************************************************************************
+* countOutcomesAvx2 is the AVX2 kernel of countOutcomes. The major ranks
+* are runs of scores, so a vector of scores is sorted into all nine of
+* them by counting the ones that reach each category floor, eight
+* compares and subtracts.
+*
+* Returns the number of candidates that improve on score, fills
+* categories[] by category-HIGH_CARD and the sum of the scores
+**************************************************************************/
+static AVX2_TARGET int countOutcomesAvx2(const CandidateDeck *candidates, uint64_t keptMask,
+                                         int score, int categories[], uint64_t *scoreSum)
+{ int fields[SUIT_COUNT], reached[CATEGORY_COUNT+1], keptKey=0, suit, j, count=0, category;
+  int32_t laneSums[CANDIDATE_LANES];
+  uint64_t sum=0;
+  __m256i suitFields, baseKey, scores, lanes, low16, sums, floors[CATEGORY_COUNT];
+  __m256i reachedLanes[CATEGORY_COUNT], key, field, rankScore, flushScore, candidateScore, valid;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { fields[suit]=SUIT_RANKS(keptMask,suit);
+    keptKey+=suitRankKey[fields[suit]];
+  }
+  suitFields=_mm256_setr_epi32(fields[0],fields[1],fields[2],fields[3],0,0,0,0);
+  baseKey=_mm256_set1_epi32(keptKey);
+  scores=_mm256_set1_epi32(score);
+  lanes=_mm256_setr_epi32(0,1,2,3,4,5,6,7);
+  low16=_mm256_set1_epi32(0xFFFF);
+  sums=_mm256_setzero_si256();
+  for(category=1; category<CATEGORY_COUNT; ++category)
+  { floors[category]=_mm256_set1_epi32(categoryFloor[category+HIGH_CARD]-1);
+    reachedLanes[category]=_mm256_setzero_si256();
+  }
+  for(j=0; j<candidates->count; j+=CANDIDATE_LANES)
+  { key=_mm256_add_epi32(baseKey,_mm256_loadu_si256((const __m256i *)&candidates->rankKey[j]));
+    field=_mm256_or_si256(_mm256_permutevar8x32_epi32(suitFields,
+            _mm256_loadu_si256((const __m256i *)&candidates->suit[j])),
+            _mm256_loadu_si256((const __m256i *)&candidates->rankBit[j]));
+    rankScore=_mm256_and_si256(_mm256_i32gather_epi32((const int *)rankTable,key,2),low16);
+    flushScore=_mm256_and_si256(_mm256_i32gather_epi32((const int *)flushTable,field,2),low16);
+    valid=_mm256_cmpgt_epi32(_mm256_set1_epi32(candidates->count-j),lanes);
+    candidateScore=_mm256_and_si256(_mm256_max_epi32(rankScore,flushScore),valid);
+    count+=POPCOUNT(_mm256_movemask_ps(_mm256_castsi256_ps(
+             _mm256_cmpgt_epi32(candidateScore,scores))));
+    sums=_mm256_add_epi32(sums,candidateScore);
+    //A true compare is -1 in every lane, so subtracting it counts
+    for(category=1; category<CATEGORY_COUNT; ++category)
+    { reachedLanes[category]=_mm256_sub_epi32(reachedLanes[category],
+                               _mm256_cmpgt_epi32(candidateScore,floors[category]));
+    }
+  }
+  _mm256_storeu_si256((__m256i *)laneSums,sums);
+  for(j=0; j<CANDIDATE_LANES; ++j) sum+=laneSums[j];
+  //Three rounds of pairwise adds leave the eight totals in one vector
+  for(category=1; category<CATEGORY_COUNT; category+=2)
+  { reachedLanes[category]=_mm256_hadd_epi32(reachedLanes[category],reachedLanes[category+1]);
+  }
+  reachedLanes[1]=_mm256_hadd_epi32(reachedLanes[1],reachedLanes[3]);
+  reachedLanes[5]=_mm256_hadd_epi32(reachedLanes[5],reachedLanes[7]);
+  reachedLanes[1]=_mm256_add_epi32(_mm256_permute2x128_si256(reachedLanes[1],reachedLanes[5],0x20),
+                                   _mm256_permute2x128_si256(reachedLanes[1],reachedLanes[5],0x31));
+  _mm256_storeu_si256((__m256i *)(reached+1),reachedLanes[1]);
+  //Every candidate reaches HIGH_CARD, none goes past STRAIGHT_FLUSH
+  reached[0]=candidates->count;
+  reached[CATEGORY_COUNT]=0;
+  for(category=0; category<CATEGORY_COUNT; ++category)
+  { categories[category]=reached[category]-reached[category+1];
+  }
+  *scoreSum=sum;
+  return count;
+}
+/************************************************************************
+* countImprovementsAvx512 is the AVX-512 kernel of countImprovements,
+* sixteen candidates at once. Lanes past the last candidate are masked
+* out of the compare instead of being compared away.
+*
+* Returns the number of candidates that improve on score
+**************************************************************************/
+static AVX512_TARGET int countImprovementsAvx512(const CandidateDeck *candidates, uint64_t keptMask,
+                                                 int score)
+{ int fields[SUIT_COUNT], keptKey=0, suit, j, count=0;
+  __m512i suitFields, baseKey, scores, low16, key, field, rankScore, flushScore;
+  __mmask16 valid;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { fields[suit]=SUIT_RANKS(keptMask,suit);
+    keptKey+=suitRankKey[fields[suit]];
+  }
+  suitFields=_mm512_setr_epi32(fields[0],fields[1],fields[2],fields[3],0,0,0,0,
+                               0,0,0,0,0,0,0,0);
+  baseKey=_mm512_set1_epi32(keptKey);
+  scores=_mm512_set1_epi32(score);
+  low16=_mm512_set1_epi32(0xFFFF);
+  for(j=0; j<candidates->count; j+=AVX512_LANES)
+  { key=_mm512_add_epi32(baseKey,_mm512_loadu_si512(&candidates->rankKey[j]));
+    field=_mm512_or_si512(_mm512_permutexvar_epi32(_mm512_loadu_si512(&candidates->suit[j]),
+                                                   suitFields),
+                          _mm512_loadu_si512(&candidates->rankBit[j]));
+    rankScore=_mm512_and_si512(_mm512_i32gather_epi32(key,(const int *)rankTable,2),low16);
+    flushScore=_mm512_and_si512(_mm512_i32gather_epi32(field,(const int *)flushTable,2),low16);
+    valid=(__mmask16)((candidates->count-j>=AVX512_LANES) ? 0xFFFF
+                      : (1<<(candidates->count-j))-1);
+    count+=POPCOUNT(_mm512_mask_cmpgt_epi32_mask(valid,_mm512_max_epi32(rankScore,flushScore),
+                                                 scores));
+  }
+  return count;
+}
+/************************************************************************
+* countOutcomesAvx512 is the AVX-512 kernel of countOutcomes. Every
+* category floor compare gives a lane mask, so the counts are popcounts
+* of masks and need no adding up across lanes afterwards.
+*
+* Returns the number of candidates that improve on score, fills
+* categories[] by category-HIGH_CARD and the sum of the scores
+**************************************************************************/
+static AVX512_TARGET int countOutcomesAvx512(const CandidateDeck *candidates, uint64_t keptMask,
+                                             int score, int categories[], uint64_t *scoreSum)
+{ int fields[SUIT_COUNT], reached[CATEGORY_COUNT+1], keptKey=0, suit, j, count=0, category;
+  __m512i suitFields, baseKey, scores, low16, sums, floors[CATEGORY_COUNT];
+  __m512i key, field, rankScore, flushScore, candidateScore;
+  __mmask16 valid;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { fields[suit]=SUIT_RANKS(keptMask,suit);
+    keptKey+=suitRankKey[fields[suit]];
+  }
+  memset(reached,0,sizeof(reached));
+  suitFields=_mm512_setr_epi32(fields[0],fields[1],fields[2],fields[3],0,0,0,0,
+                               0,0,0,0,0,0,0,0);
+  baseKey=_mm512_set1_epi32(keptKey);
+  scores=_mm512_set1_epi32(score);
+  low16=_mm512_set1_epi32(0xFFFF);
+  sums=_mm512_setzero_si512();
+  for(category=1; category<CATEGORY_COUNT; ++category)
+  { floors[category]=_mm512_set1_epi32(categoryFloor[category+HIGH_CARD]-1);
+  }
+  for(j=0; j<candidates->count; j+=AVX512_LANES)
+  { key=_mm512_add_epi32(baseKey,_mm512_loadu_si512(&candidates->rankKey[j]));
+    field=_mm512_or_si512(_mm512_permutexvar_epi32(_mm512_loadu_si512(&candidates->suit[j]),
+                                                   suitFields),
+                          _mm512_loadu_si512(&candidates->rankBit[j]));
+    rankScore=_mm512_and_si512(_mm512_i32gather_epi32(key,(const int *)rankTable,2),low16);
+    flushScore=_mm512_and_si512(_mm512_i32gather_epi32(field,(const int *)flushTable,2),low16);
+    valid=(__mmask16)((candidates->count-j>=AVX512_LANES) ? 0xFFFF
+                      : (1<<(candidates->count-j))-1);
+    candidateScore=_mm512_maskz_max_epi32(valid,rankScore,flushScore);
+    count+=POPCOUNT(_mm512_cmpgt_epi32_mask(candidateScore,scores));
+    sums=_mm512_add_epi32(sums,candidateScore);
+    for(category=1; category<CATEGORY_COUNT; ++category)
+    { reached[category]+=POPCOUNT(_mm512_cmpgt_epi32_mask(candidateScore,floors[category]));
+    }
+  }
+  //Every candidate reaches HIGH_CARD, none goes past STRAIGHT_FLUSH
+  reached[0]=candidates->count;
+  for(category=0; category<CATEGORY_COUNT; ++category)
+  { categories[category]=reached[category]-reached[category+1];
+  }
+  *scoreSum=(uint64_t)_mm512_reduce_add_epi32(sums);
+  return count;
+}
+#endif
+/************************************************************************
+* buildRemainingDeck lists the bit of every card that is not in mask
+*
+* Returns the number of cards written to deck[]
+**************************************************************************/
+static int buildRemainingDeck(uint64_t mask, uint64_t deck[])
+{ int bit, count=0;
+  for(bit=0; bit<DECK_SIZE; ++bit)
+  { if((mask & ((uint64_t)1<<bit))==0) deck[count++]=(uint64_t)1<<bit;
+  }
+  return count;
+}
+/************************************************************************
+* Empirical version of getProbabilities, each discard is replaced by
+* sampleNumber random cards. Kept for teaching and to validate the
+* exact method. The samples of every discard are cut into chunks of
+* SAMPLE_CHUNK_SIZE that the thread pool works through in any order.
+* Each chunk seeds its own generator from the canonical hand, the discard
+* and the chunk number, so a seed gives the same answer for any thread
+* count and for every suit permutation of a hand.
+* In ADAPTIVE_MODE a discard is one chunk that stops early once it is
+* within the precision, so the five discards run side by side.
+* The blocks of all chunks of a discard are added up into its variance.
+*
+* No returns, results go into canonicalImprovements[],
+* canonicalSamplesDrawn[] and canonicalVariances[]
+**************************************************************************/
+static void getSampledProbabilities(PokerContext *context)
+{ const PokerOptions *options=&context->options;
+  SampleTask *tasks=context->sampleTasks;
+  int i, j, chunkCount=context->chunkCount;
+  uint64_t keptMask, cards=context->canonicalMask;
+  for(i=0; i<HAND_SIZE; ++i, cards&=cards-1)
+  { keptMask=context->canonicalMask & ~(cards & -cards);
+    for(j=0; j<chunkCount; ++j)
+    { SampleTask *task=&tasks[i*chunkCount+j];
+      task->deck=context->remainingDeck;
+      task->deckSize=context->remainingCount;
+      task->keptMask=keptMask;
+      task->handScore=context->handScore;
+      task->sampleCount=MIN(SAMPLE_CHUNK_SIZE,options->sampleNumber-j*SAMPLE_CHUNK_SIZE);
+      task->precision=0;
+      task->sampling=options->sampling;
+      task->histogram=options->histogram;
+      if(options->mode==ADAPTIVE_MODE)
+      { task->sampleCount=options->sampleNumber;
+        task->precision=options->precision;
+      }
+      pokerSeedRandom(&task->random,mixSeed(options->seed,context->canonicalMask,i*chunkCount+j));
+    }
+  }
+  runParallel(&context->pool,HAND_SIZE*chunkCount,runSampleTask,tasks);
+  //Reduce in task order, the sums do not depend on who ran what
+  for(i=0; i<HAND_SIZE; ++i)
+  { uint64_t squares=0, cross=0, sizes=0;
+    int blocks=0, category;
+    context->canonicalImprovements[i]=context->canonicalSamplesDrawn[i]=0;
+    memset(context->canonicalCategories[i],0,sizeof(context->canonicalCategories[i]));
+    context->canonicalScoreSums[i]=0;
+    for(j=0; j<chunkCount; ++j)
+    { SampleTask *task=&tasks[i*chunkCount+j];
+      context->canonicalImprovements[i]+=task->numOfImprovements;
+      context->canonicalSamplesDrawn[i]+=task->samplesDrawn;
+      blocks+=task->blockCount;
+      squares+=task->blockSquares;
+      cross+=task->blockCross;
+      sizes+=task->blockSizes;
+      for(category=0; category<CATEGORY_COUNT; ++category)
+      { context->canonicalCategories[i][category]+=task->categories[category];
+      }
+      context->canonicalScoreSums[i]+=task->scoreSum;
+    }
+    context->canonicalVariances[i]=blockVariance(context->canonicalImprovements[i],
+                                                 context->canonicalSamplesDrawn[i],
+                                                 blocks,squares,cross,sizes);
+  }
+}
+/************************************************************************
+* Runs one chunk of samples for getSampledProbabilities. Only touches
+* the task it is handed, so any number of these can run at once. Every
+* draw is an unbiased pick out of the remaining deck, so there is no
+* rejection loop. The kept cards sit in a HandState, each draw is added
+* to it, scored and taken back out.
+*
+* The draws come in blocks of SAMPLE_BLOCK_SIZE, each randomized on its
+* own so the blocks are independent and their spread gives the
+* variance. RANDOM_SAMPLING picks every card at random. With
+* STRATIFIED_SAMPLING every card of the deck is a stratum and a block
+* walks them in turn from a random start, so each card gets its share
+* of the draws. SOBOL_SAMPLING picks cards by the points of a Sobol
+* sequence, shifted by a random XOR per block. With histogram every draw
+* is also counted by major rank. A chunk with a precision
+* checks its confidence interval after every block: the Wilson interval
+* for independent draws, the variance of the blocks otherwise.
+*
+* Takes the index of the task in the SampleTask array passed as arg
+**************************************************************************/
+static void runSampleTask(int taskIndex, void *arg)
+{ SampleTask *task=(SampleTask *)arg+taskIndex;
+  PokerRandomState random=task->random;
+  HandState state;
+  uint32_t point=0, shift=0;
+  int j, card, pick, score, blockStart, blockEnd, blockImprovements, offset=0, numOfImprovements=0;
+  double halfWidth;
+  initHandState(&state,task->keptMask);
+  memset(task->categories,0,sizeof(task->categories));
+  task->scoreSum=0;
+  task->blockCount=0;
+  task->blockSquares=task->blockCross=task->blockSizes=0;
+  for(j=0; j<task->sampleCount; )
+  { blockStart=j;
+    blockEnd=MIN(j+SAMPLE_BLOCK_SIZE,task->sampleCount);
+    blockImprovements=0;
+    if(task->sampling==STRATIFIED_SAMPLING) offset=pokerRandomBelow(&random,task->deckSize);
+    if(task->sampling==SOBOL_SAMPLING)
+    { shift=(uint32_t)pokerNextRandom(&random);
+      point=0;
+    }
+    for(; j<blockEnd; ++j)
+    { if(task->sampling==RANDOM_SAMPLING) pick=pokerRandomBelow(&random,task->deckSize);
+      else if(task->sampling==STRATIFIED_SAMPLING) pick=(offset+j-blockStart)%task->deckSize;
+      else
+      { pick=(int)(((uint64_t)(point^shift)*task->deckSize)>>SOBOL_BITS);
+        point^=sobolDirections[0][__builtin_ctz(j-blockStart+1)];
+      }
+      card=__builtin_ctzll(task->deck[pick]);
+      addCard(&state,card);
+      score=handStateScore(&state);
+      blockImprovements+=score>task->handScore;
+      if(task->histogram==TRUE)
+      { ++task->categories[scoreCategory[score]-HIGH_CARD];
+        task->scoreSum+=score;
+      }
+      removeCard(&state,card);
+    }
+    numOfImprovements+=blockImprovements;
+    ++task->blockCount;
+    task->blockSquares+=(uint64_t)blockImprovements*blockImprovements;
+    task->blockCross+=(uint64_t)blockImprovements*(j-blockStart);
+    task->blockSizes+=(uint64_t)(j-blockStart)*(j-blockStart);
+    if(task->precision>0)
+    { if(task->sampling==RANDOM_SAMPLING) halfWidth=confidenceHalfWidth(numOfImprovements,j);
+      else if(task->blockCount<ADAPTIVE_MIN_BLOCKS) continue;
+      else halfWidth=100*CONFIDENCE_Z*sqrt(blockVariance(numOfImprovements,j,task->blockCount,
+                                                         task->blockSquares,task->blockCross,
+                                                         task->blockSizes));
+      if(halfWidth<task->precision) break;
+    }
+  }
+  task->numOfImprovements=numOfImprovements;
+  task->samplesDrawn=j;
+}
+/************************************************************************
+* blockVariance estimates the variance of a sampled probability from the
+* independent blocks it was drawn in, as the spread of the block
+* results around the overall estimate. It works the same for any way of
+* drawing inside a block, which is what lets the sampling methods be
+* compared. A single block has no spread, so it gets the variance of
+* that many independent draws.
+*
+* Returns the variance of the probability as a fraction
+* Takes the improvements, draws and blocks, and the sums over the blocks
+* of improvements squared, improvements times draws and draws squared
+**************************************************************************/
+static double blockVariance(int successes, int trials, int blocks, uint64_t squares,
+                            uint64_t cross, uint64_t sizes)
+{ double p=(double)successes/trials, spread;
+  if(blocks<2) return p*(1-p)/trials;
+  spread=(double)squares-2*p*(double)cross+p*p*(double)sizes;
+  return blocks/(blocks-1.0)*MAX(spread,0)/((double)trials*trials);
+}
+/************************************************************************
+* buildSobolDirections works out the direction numbers of the first
+* HAND_SIZE Sobol dimensions from their polynomials, with the usual
+* recurrence v[k] = v[k-s] ^ v[k-s]>>s ^ the v[k-l] the coefficients
+* pick. Dimension 0 is the bit reversal of the point index.
+*
+* No returns no parameters, fills sobolDirections[][]
+**************************************************************************/
+static void buildSobolDirections(void)
+{ int d, k, l, s;
+  for(k=0; k<SOBOL_BITS; ++k) sobolDirections[0][k]=(uint32_t)1<<(SOBOL_BITS-1-k);
+  for(d=1; d<HAND_SIZE; ++d)
+  { s=SOBOL_DEGREE[d];
+    for(k=0; k<SOBOL_BITS; ++k)
+    { if(k<s)
+      { sobolDirections[d][k]=SOBOL_INITIAL[d][k]<<(SOBOL_BITS-1-k);
+        continue;
+      }
+      sobolDirections[d][k]=sobolDirections[d][k-s]^(sobolDirections[d][k-s]>>s);
+      for(l=1; l<s; ++l)
+      { if((SOBOL_COEFFICIENTS[d]>>(s-1-l)) & 1) sobolDirections[d][k]^=sobolDirections[d][k-l];
+      }
+    }
+  }
+}
+/************************************************************************
+* confidenceHalfWidth gives the half-width of the 95% Wilson score
+* interval of a sampled probability. Unlike the textbook p(1-p)/n
+* interval it does not collapse to 0 when no improvement has been seen
+* yet, so a hand that cannot improve still needs a few thousand draws.
+*
+* Returns the half-width in percentage points
+**************************************************************************/
+static double confidenceHalfWidth(int successes, int trials)
+{ double n=trials, p=successes/n, z2=CONFIDENCE_Z*CONFIDENCE_Z;
+  return 100*CONFIDENCE_Z/(1+z2/n)*sqrt(p*(1-p)/n+z2/(4*n*n));
+}
+/************************************************************************
+* buildDrawSubsets lists the discard subsets of every size, a subset
+* having bit i set when card i of the canonical hand is thrown away
+*
+* No returns no parameters, fills drawSubsets[][] and drawSubsetCount[]
+**************************************************************************/
+static void buildDrawSubsets(void)
+{ int subset, size;
+  for(subset=0; subset<SUBSET_COUNT; ++subset)
+  { size=POPCOUNT(subset);
+    drawSubsets[size][drawSubsetCount[size]++]=subset;
+  }
+}
+/************************************************************************
+* Draw version of getProbabilities, covers all SUBSET_COUNT ways of
+* discarding cards instead of single discards. For every subset it
+* finds how often the new hand beats the input and the mean score it
+* ends on. The draws are enumerated exactly up to DRAW_EXACT_LIMIT cards
+* and sampled above that.
+*
+* Draws of one size are shared by all subsets of that size: a drawn set
+* is scored against the kept cards of each of them, and the enumeration
+* adds one card per level to a HandState, so drawing three cards reuses
+* the state of the first two.
+*
+* No returns, fills drawImprovements[], drawScoreSums[] and
+* drawTrials[] by canonical subset
+**************************************************************************/
+static void getDrawProbabilities(PokerContext *context)
+{ HandState kept, drawn;
+  uint64_t improvements[SUBSET_COUNT], scoreSums[SUBSET_COUNT], cards;
+  int subset, size, i, suit;
+  context->remainingCount=buildRemainingDeck(context->canonicalMask|context->canonicalDead,
+                                             context->remainingDeck);
+  for(subset=0; subset<SUBSET_COUNT; ++subset)
+  { initHandState(&kept,context->canonicalMask);
+    for(cards=context->canonicalMask, i=0; i<HAND_SIZE; ++i, cards&=cards-1)
+    { if(subset & (1<<i)) removeCard(&kept,__builtin_ctzll(cards));
+    }
+    context->drawKeptKey[subset]=kept.rankKey;
+    for(suit=0; suit<SUIT_COUNT; ++suit)
+    { context->drawKeptFields[subset][suit]=kept.suitFields[suit];
+    }
+  }
+  //Standing pat always ends on the input hand
+  context->drawImprovements[0]=0;
+  context->drawScoreSums[0]=context->handScore;
+  context->drawTrials[0]=1;
+  for(size=1; size<=MIN(DRAW_EXACT_LIMIT,HAND_SIZE); ++size)
+  { memset(improvements,0,sizeof(improvements));
+    memset(scoreSums,0,sizeof(scoreSums));
+    initHandState(&drawn,0);
+    enumerateDraws(context,&drawn,size,0,improvements,scoreSums);
+    for(i=0; i<drawSubsetCount[size]; ++i)
+    { context->drawImprovements[drawSubsets[size][i]]=improvements[i];
+      context->drawScoreSums[drawSubsets[size][i]]=scoreSums[i];
+      context->drawTrials[drawSubsets[size][i]]=binomial[context->remainingCount][size];
+    }
+  }
+  if(DRAW_EXACT_LIMIT<HAND_SIZE) sampleDraws(context);
+  for(subset=1; subset<SUBSET_COUNT; ++subset) context->evaluations+=context->drawTrials[subset];
+}
+/************************************************************************
+* enumerateDraws walks every set of cardsLeft more cards from
+* remainingDeck[start...], adding one card per level to drawn, and
+* scores every complete draw with scoreDraw
+*
+* No returns, results are added into improvements[] and scoreSums[]
+**************************************************************************/
+static void enumerateDraws(const PokerContext *context, HandState *drawn, int cardsLeft, int start,
+                           uint64_t improvements[], uint64_t scoreSums[])
+{ int j, card;
+  for(j=start; j<=context->remainingCount-cardsLeft; ++j)
+  { card=__builtin_ctzll(context->remainingDeck[j]);
+    addCard(drawn,card);
+    if(cardsLeft==1) scoreDraw(context,drawn,improvements,scoreSums);
+    else enumerateDraws(context,drawn,cardsLeft-1,j+1,improvements,scoreSums);
+    removeCard(drawn,card);
+  }
+}
+/************************************************************************
+* scoreDraw scores a set of drawn cards with the kept cards of every
+* subset that discards as many cards as were drawn. The kept and drawn
+* rank keys just add, and a flush has to include the card drawn last,
+* so only that suit's field is looked at.
+*
+* No returns, adds into improvements[] and scoreSums[] at the place of
+* each subset in drawSubsets[]
+**************************************************************************/
+static void scoreDraw(const PokerContext *context, const HandState *drawn,
+                      uint64_t improvements[], uint64_t scoreSums[])
+{ int size=POPCOUNT(drawn->mask), suit=drawn->lastSuit, i, subset, score;
+  for(i=0; i<drawSubsetCount[size]; ++i)
+  { subset=drawSubsets[size][i];
+    score=MAX(rankTable[context->drawKeptKey[subset]+drawn->rankKey],
+              flushTable[context->drawKeptFields[subset][suit] | drawn->suitFields[suit]]);
+    improvements[i]+=score>context->handScore;
+    scoreSums[i]+=score;
+  }
+}
+/************************************************************************
+* sampleDraws estimates the draws of more than DRAW_EXACT_LIMIT cards
+* with sampleNumber random draws per size, cut into chunks for the
+* thread pool and seeded per chunk like getSampledProbabilities.
+*
+* No returns, fills the draw results of those sizes
+**************************************************************************/
+static void sampleDraws(PokerContext *context)
+{ DrawTask *tasks=context->drawTasks;
+  int i, j, size, sampleNumber=context->options.sampleNumber, chunkCount=context->chunkCount;
+  memset(tasks,0,context->drawTaskCount*sizeof(DrawTask));
+  for(i=0; i<context->drawTaskCount; ++i)
+  { tasks[i].drawSize=DRAW_EXACT_LIMIT+1+i/chunkCount;
+    tasks[i].sampleCount=MIN(SAMPLE_CHUNK_SIZE,sampleNumber-(i%chunkCount)*SAMPLE_CHUNK_SIZE);
+    pokerSeedRandom(&tasks[i].random,mixSeed(context->options.seed,context->canonicalMask,i));
+  }
+  runParallel(&context->pool,context->drawTaskCount,runDrawTask,context);
+  //Reduce in task order, the sums do not depend on who ran what
+  for(size=DRAW_EXACT_LIMIT+1; size<=HAND_SIZE; ++size)
+  { for(i=0; i<drawSubsetCount[size]; ++i)
+    { DrawTask *task=&tasks[(size-DRAW_EXACT_LIMIT-1)*chunkCount];
+      int subset=drawSubsets[size][i];
+      context->drawImprovements[subset]=context->drawScoreSums[subset]
+        =context->drawTrials[subset]=0;
+      for(j=0; j<chunkCount; ++j)
+      { context->drawImprovements[subset]+=task[j].improvements[i];
+        context->drawScoreSums[subset]+=task[j].scoreSums[i];
+        context->drawTrials[subset]+=task[j].sampleCount;
+      }
+    }
+  }
+}
+/************************************************************************
+* Runs one chunk of sampled draws for sampleDraws. Each draw is a
+* partial Fisher-Yates shuffle of the chunk's own copy of the deck, the
+* first drawSize places being the drawn cards. The copy stays a
+* permutation of the deck, so it need not be reset between draws, and
+* place[] follows where every card is in it. The context is only read,
+* every write goes to the task.
+*
+* The sampling option picks the shuffle like in runSampleTask, block by
+* block: STRATIFIED_SAMPLING takes the first card of a draw from the
+* deck in turn and the rest at random, SOBOL_SAMPLING takes place j of
+* a draw from Sobol dimension j.
+*
+* Takes the index of the task in drawTasks of the context passed as arg
+**************************************************************************/
+static void runDrawTask(int taskIndex, void *arg)
+{ const PokerContext *context=arg;
+  DrawTask *task=&context->drawTasks[taskIndex];
+  PokerRandomState random=task->random;
+  HandState drawn;
+  uint8_t deck[DECK_SIZE], order[DECK_SIZE], place[DECK_SIZE], card;
+  uint32_t points[HAND_SIZE], shifts[HAND_SIZE];
+  int i, j, pick, offset=0, remainingCount=context->remainingCount;
+  int sampling=context->options.sampling;
+  for(j=0; j<remainingCount; ++j)
+  { deck[j]=order[j]=__builtin_ctzll(context->remainingDeck[j]);
+    place[deck[j]]=j;
+  }
+  for(i=0; i<task->sampleCount; ++i)
+  { if(i%SAMPLE_BLOCK_SIZE==0)
+    { if(sampling==STRATIFIED_SAMPLING) offset=pokerRandomBelow(&random,remainingCount);
+      for(j=0; j<task->drawSize && sampling==SOBOL_SAMPLING; ++j)
+      { shifts[j]=(uint32_t)pokerNextRandom(&random);
+        points[j]=0;
+      }
+    }
+    initHandState(&drawn,0);
+    for(j=0; j<task->drawSize; ++j)
+    { if(sampling==SOBOL_SAMPLING)
+      { pick=j+(int)(((uint64_t)(points[j]^shifts[j])*(remainingCount-j))>>SOBOL_BITS);
+        points[j]^=sobolDirections[j][__builtin_ctz(i%SAMPLE_BLOCK_SIZE+1)];
+      }
+      else if(sampling==STRATIFIED_SAMPLING && j==0)
+      { pick=place[order[(offset+i%SAMPLE_BLOCK_SIZE)%remainingCount]];
+      }
+      else pick=j+pokerRandomBelow(&random,remainingCount-j);
+      card=deck[pick];
+      deck[pick]=deck[j];
+      deck[j]=card;
+      place[deck[pick]]=pick;
+      place[card]=j;
+      addCard(&drawn,card);
+    }
+    scoreDraw(context,&drawn,task->improvements,task->scoreSums);
+  }
+}
+/************************************************************************
+* placeDrawResults turns the draw results into result, one entry per
+* subset of input cards, bit i being card i of hand. Each input subset
+* is turned into the canonical subset it was worked out as, card by
+* card. The single card discards are also put in probabilities[].
+*
+* No returns, fills the draw fields of result
+**************************************************************************/
+static void placeDrawResults(const PokerContext *context, const PokerHand *hand,
+                             PokerResult *result)
+{ int slots[HAND_SIZE], subset, canonical, i, card;
+  for(i=0; i<HAND_SIZE; ++i)
+  { card=hand->cards[i];
+    slots[i]=POPCOUNT(context->canonicalMask
+             & (CARD_BIT(card%RANK_COUNT,context->suitMap[card/RANK_COUNT])-1));
+  }
+  for(subset=0; subset<SUBSET_COUNT; ++subset)
+  { canonical=0;
+    for(i=0; i<HAND_SIZE; ++i)
+    { if(subset & (1<<i)) canonical|=1<<slots[i];
+    }
+    result->drawImprovement[subset]
+      =100*(double)context->drawImprovements[canonical]/context->drawTrials[canonical];
+    result->drawExpectedScore[subset]
+      =(double)context->drawScoreSums[canonical]/context->drawTrials[canonical];
+  }
+  for(i=0; i<HAND_SIZE; ++i)
+  { result->probabilities[i]=(float)result->drawImprovement[1<<i];
+    result->samplesDrawn[i]=(int)context->drawTrials[1<<slots[i]];
+  }
+}
+/************************************************************************
+* getEquity plays the hand against options.opponents random hands in
+* sampleNumber deals, cut into chunks for the thread pool and seeded per
+* chunk like getSampledProbabilities, so the result does not depend on
+* the thread count.
+*
+* No returns, fills equityWins, equityTies, equityShares and
+* equityDeals
+**************************************************************************/
+static void getEquity(PokerContext *context)
+{ EquityTask *tasks=context->equityTasks;
+  int i, sampleNumber=context->options.sampleNumber, chunkCount=context->chunkCount;
+  context->remainingCount=buildRemainingDeck(context->canonicalMask|context->canonicalDead,
+                                             context->remainingDeck);
+  memset(tasks,0,chunkCount*sizeof(EquityTask));
+  for(i=0; i<chunkCount; ++i)
+  { tasks[i].sampleCount=MIN(SAMPLE_CHUNK_SIZE,sampleNumber-i*SAMPLE_CHUNK_SIZE);
+    pokerSeedRandom(&tasks[i].random,mixSeed(context->options.seed,context->canonicalMask,i));
+  }
+  runParallel(&context->pool,chunkCount,runEquityTask,context);
+  //Reduce in task order, the sums do not depend on who ran what
+  context->equityWins=context->equityTies=context->equityShares=context->equityDeals=0;
+  for(i=0; i<chunkCount; ++i)
+  { context->equityWins+=tasks[i].wins;
+    context->equityTies+=tasks[i].ties;
+    context->equityShares+=tasks[i].shares;
+    context->equityDeals+=tasks[i].sampleCount;
+    context->evaluations+=tasks[i].evaluations;
+  }
+}
+/************************************************************************
+* Runs one chunk of deals for getEquity. Each opponent is a partial
+* Fisher-Yates shuffle of the next HAND_SIZE places of the chunk's own
+* copy of the deck, so no card is ever drawn twice and nothing is
+* rejected. The copy stays a permutation of the deck and is not reset
+* between deals. The first opponent that beats the hand ends the deal,
+* the cards of the rest would change nothing. Scores are the integer
+* scores of pokerEvaluateHand, a split pot is shared out in whole
+* EQUITY_SHARE_UNITs so the sums are exact.
+*
+* Takes the index of the task in equityTasks of the context passed as arg
+**************************************************************************/
+static void runEquityTask(int taskIndex, void *arg)
+{ const PokerContext *context=arg;
+  EquityTask *task=&context->equityTasks[taskIndex];
+  PokerRandomState random=task->random;
+  uint8_t deck[DECK_SIZE];
+  uint64_t wins=0, ties=0, shares=0, evaluations=0;
+  int i, opponent, score, tiedWith, handScore=context->handScore;
+  int opponents=context->options.opponents, remainingCount=context->remainingCount;
+  for(i=0; i<remainingCount; ++i) deck[i]=__builtin_ctzll(context->remainingDeck[i]);
+  for(i=0; i<task->sampleCount; ++i)
+  { tiedWith=0;
+    for(opponent=0; opponent<opponents; ++opponent)
+    { score=pokerEvaluateHand(dealHand(deck,opponent*HAND_SIZE,remainingCount,&random));
+      ++evaluations;
+      if(score>handScore) break;
+      tiedWith+=score==handScore;
+    }
+    if(opponent<opponents) continue;
+    wins+=tiedWith==0;
+    ties+=tiedWith>0;
+    shares+=EQUITY_SHARE_UNIT/(tiedWith+1);
+  }
+  task->wins=wins;
+  task->ties=ties;
+  task->shares=shares;
+  task->evaluations=evaluations;
+}
+/************************************************************************
+* dealHand deals HAND_SIZE cards into deck[start...] with a partial
+* Fisher-Yates shuffle of deck[start...remainingCount-1]. The random
+* words of the whole hand are drawn up front, two picks per call of the
+* generator, so the multiplies that turn them into picks do not wait on
+* each other.
+*
+* Returns the card mask of the cards dealt
+**************************************************************************/
+static uint64_t dealHand(uint8_t deck[], int start, int remainingCount, PokerRandomState *random)
+{ uint64_t words[(HAND_SIZE+1)/2], mask=0;
+  uint8_t card;
+  int j, pick;
+  for(j=0; j<(HAND_SIZE+1)/2; ++j) words[j]=pokerNextRandom(random);
+  for(j=0; j<HAND_SIZE; ++j)
+  { pick=start+j+pickBelow(random,(uint32_t)(words[j/2]>>((j & 1) ? 0 : 32)),
+                           remainingCount-start-j);
+    card=deck[pick];
+    deck[pick]=deck[start+j];
+    deck[start+j]=card;
+    mask|=(uint64_t)1<<card;
+  }
+  return mask;
+}
+/************************************************************************
+* placeEquity turns the deal counts into the percentages of result
+*
+* No returns, fills the equity fields of result
+**************************************************************************/
+static void placeEquity(const PokerContext *context, PokerResult *result)
+{ result->equityDeals=(int)context->equityDeals;
+  result->winProbability=100*(double)context->equityWins/context->equityDeals;
+  result->tieProbability=100*(double)context->equityTies/context->equityDeals;
+  result->equity=100*(double)context->equityShares/((double)EQUITY_SHARE_UNIT*context->equityDeals);
+}
+/************************************************************************
+* mixSeed derives the generator seed of one chunk of samples from the
+* run's seed, the hand and the chunk's place in the task list, with the
+* splitmix64 finalizer so neighbouring chunks get unrelated streams.
+*
+* Returns the seed
+**************************************************************************/
+static uint64_t mixSeed(uint64_t seed, uint64_t hand, int chunk)
+{ uint64_t z=seed ^ (hand*0x9E3779B97F4A7C15ULL) ^ ((uint64_t)chunk<<48);
+  z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+  z=(z^(z>>27))*0x94D049BB133111EBULL;
+  return z^(z>>31);
+}
+/************************************************************************
+* pokerSeedRandom fills the four state words of a generator from one
+* seed with splitmix64, as the xoshiro authors recommend.
+**************************************************************************/
+void pokerSeedRandom(PokerRandomState *random, uint64_t seed)
+{ int i;
+  uint64_t z;
+  for(i=0; i<4; ++i)
+  { z=(seed+=0x9E3779B97F4A7C15ULL);
+    z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+    z=(z^(z>>27))*0x94D049BB133111EBULL;
+    random->s[i]=z^(z>>31);
+  }
+}
+/************************************************************************
+* pokerNextRandom steps a xoshiro256** generator
+*
+* Returns 64 random bits
+**************************************************************************/
+uint64_t pokerNextRandom(PokerRandomState *random)
+{ uint64_t *s=random->s;
+  uint64_t result=s[1]*5, t=s[1]<<17;
+  result=((result<<7)|(result>>57))*9;
+  s[2]^=s[0];
+  s[3]^=s[1];
+  s[1]^=s[2];
+  s[0]^=s[3];
+  s[2]^=t;
+  s[3]=(s[3]<<45)|(s[3]>>19);
+  return result;
+}
+/************************************************************************
+* pokerRandomBelow draws an integer in [0,bound) without the bias of %,
+* by Lemire's multiply and shift. Only a sliver of the 2^32 outcomes is
+* redrawn, and the division behind that check is rarely reached.
+*
+* Returns the integer, takes the generator and a bound above 0
+**************************************************************************/
+uint32_t pokerRandomBelow(PokerRandomState *random, uint32_t bound)
+{ return pickBelow(random,(uint32_t)(pokerNextRandom(random)>>32),bound);
+}
+/************************************************************************
+* pickBelow turns a 32 bit random word into a pick below bound with
+* Lemire's multiply and shift, drawing new words in the rare case the
+* pick would be biased.
+*
+* Returns a number in [0, bound)
+**************************************************************************/
+static uint32_t pickBelow(PokerRandomState *random, uint32_t word, uint32_t bound)
+{ uint64_t product=(uint64_t)word*bound;
+  uint32_t low=(uint32_t)product, threshold;
+  if(low<bound)
+  { threshold=(uint32_t)(-bound)%bound;
+    while(low<threshold)
+    { product=(pokerNextRandom(random)>>32)*bound;
+      low=(uint32_t)product;
+    }
+  }
+  return (uint32_t)(product>>32);
+}
+/************************************************************************
+* startThreadPool starts threadCount-1 workers, the calling thread is
+* the last worker. With one thread nothing is started and runParallel
+* runs every task in line.
+*
+* Returns TRUE if the workers started, FALSE otherwise
+**************************************************************************/
+static int startThreadPool(ThreadPool *pool, int threadCount)
+{ int i;
+  pthread_mutex_init(&pool->lock,NULL);
+  pthread_cond_init(&pool->workReady,NULL);
+  pthread_cond_init(&pool->workDone,NULL);
+  pool->generation=pool->shutdown=0;
+  pool->taskCount=pool->nextTask=pool->tasksLeft=0;
+  pool->threadCount=threadCount;
+  for(i=0; i<threadCount-1; ++i)
+  { if(pthread_create(&pool->threads[i],NULL,poolWorker,pool)!=0)
+    { pool->threadCount=i+1;
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+/************************************************************************
+* stopThreadPool wakes every worker with the shutdown flag and waits
+* for them to exit. A pool that was never started is left alone.
+**************************************************************************/
+static void stopThreadPool(ThreadPool *pool)
+{ int i;
+  if(pool->threadCount==0) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown=TRUE;
+  pthread_cond_broadcast(&pool->workReady);
+  pthread_mutex_unlock(&pool->lock);
+  for(i=0; i<pool->threadCount-1; ++i) pthread_join(pool->threads[i],NULL);
+  pthread_cond_destroy(&pool->workDone);
+  pthread_cond_destroy(&pool->workReady);
+  pthread_mutex_destroy(&pool->lock);
+  pool->threadCount=0;
+}
+/************************************************************************
+* runParallel calls run(task,arg) once for every task below taskCount
+* on the pool and returns when all of them have finished. Tasks are
+* handed out one at a time, so uneven tasks still balance.
+**************************************************************************/
+static void runParallel(ThreadPool *pool, int taskCount, void (*run)(int, void *), void *arg)
+{ int i;
+  if(pool->threadCount<=1)
+  { for(i=0; i<taskCount; ++i) run(i,arg);
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->run=run;
+  pool->arg=arg;
+  pool->taskCount=pool->tasksLeft=taskCount;
+  pool->nextTask=0;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->workReady);
+  pthread_mutex_unlock(&pool->lock);
+  runPoolTasks(pool);
+  pthread_mutex_lock(&pool->lock);
+  while(pool->tasksLeft>0) pthread_cond_wait(&pool->workDone,&pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+/************************************************************************
+* runPoolTasks takes tasks of the current job off the pool until none
+* are left, shared by the workers and the thread calling runParallel.
+**************************************************************************/
+static void runPoolTasks(ThreadPool *pool)
+{ int task;
+  pthread_mutex_lock(&pool->lock);
+  while(pool->nextTask<pool->taskCount)
+  { task=pool->nextTask++;
+    pthread_mutex_unlock(&pool->lock);
+    pool->run(task,pool->arg);
+    pthread_mutex_lock(&pool->lock);
+    if(--pool->tasksLeft==0) pthread_cond_signal(&pool->workDone);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+/************************************************************************
+* Body of a pool worker: sleeps until runParallel posts a new job,
+* helps finish it, and exits once stopThreadPool sets shutdown.
+*
+* Takes the ThreadPool it works for
+**************************************************************************/
+static void *poolWorker(void *arg)
+{ ThreadPool *pool=arg;
+  int generation=0;
+  pthread_mutex_lock(&pool->lock);
+  for(;;)
+  { while(pool->generation==generation && !pool->shutdown)
+    { pthread_cond_wait(&pool->workReady,&pool->lock);
+    }
+    if(pool->shutdown) break;
+    generation=pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    runPoolTasks(pool);
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+/********************************************************************
+* Sorts a hand according to rank from lowest to highest. A card is
+* its bit index, so the suit always sticks with the rank. This will
+* make the process of determining the rank of hands much simpler
+*
+* No returns, takes the hand to sort
+* Each card is packed into the byte SORT_KEY, rank<<2|suit, and the
+* keys go through SORT_FIVE, the nine compare-exchanges that sort any
+* five values. A compare-exchange is a MIN and a MAX, which compile to
+* conditional moves, so no branch depends on the cards. Equal ranks
+* come out in suit order, whatever order they went in.
+********************************************************************/
+void pokerSortHand(PokerHand *hand)
+{ uint8_t keys[HAND_SIZE], low;
+  int i;
+  for(i=0; i<HAND_SIZE; ++i) keys[i]=SORT_KEY(hand->cards[i]);
+  SORT_FIVE(COMPARE_SWAP,keys);
+  for(i=0; i<HAND_SIZE; ++i) hand->cards[i]=KEY_CARD(keys[i]);
+}
+/********************************************************************
+* pokerSortHandOrder sorts a hand like pokerSortHand and tells where
+* every card went, for callers that replace a card and then need to find
+* it in the sorted hand. The input place of a card rides in the low bits
+* of its key, below the rank and suit, so it never changes the order and
+* is read back off the sorted keys.
+*
+* No returns, takes the hand to sort and fills positions[i] with the
+* sorted place of what was cards[i]
+********************************************************************/
+void pokerSortHandOrder(PokerHand *hand, uint8_t positions[])
+{ uint16_t keys[HAND_SIZE], low;
+  int i;
+  for(i=0; i<HAND_SIZE; ++i) keys[i]=(uint16_t)(SORT_KEY(hand->cards[i])<<SORT_PLACE_BITS | i);
+  SORT_FIVE(COMPARE_SWAP,keys);
+  for(i=0; i<HAND_SIZE; ++i)
+  { positions[keys[i] & SORT_PLACE_MASK]=(uint8_t)i;
+    hand->cards[i]=KEY_CARD(keys[i]>>SORT_PLACE_BITS);
+  }
+}
+/********************************************************************
+* pokerSortHands sorts a batch of hands like pokerSortHand. The keys of
+* SORT_LANES hands at a time are laid out card by card, keys[i] holding
+* card i of every hand, so each compare-exchange of SORT_FIVE works on
+* all of them at once in the sortKeys kernel.
+*
+* No returns, takes the hands and how many there are
+********************************************************************/
+void pokerSortHands(PokerHand hands[], int count)
+{ uint8_t keys[HAND_SIZE][SORT_LANES];
+  int first, lanes, lane, i;
+  pthread_once(&kernelOnce,selectKernel);
+  for(first=0; first<count; first+=SORT_LANES)
+  { lanes=MIN(count-first,SORT_LANES);
+    if(lanes<SORT_LANES) memset(keys,0,sizeof(keys));
+    for(lane=0; lane<lanes; ++lane)
+    { for(i=0; i<HAND_SIZE; ++i) keys[i][lane]=SORT_KEY(hands[first+lane].cards[i]);
+    }
+    kernel->sortKeys(keys);
+    for(lane=0; lane<lanes; ++lane)
+    { for(i=0; i<HAND_SIZE; ++i) hands[first+lane].cards[i]=KEY_CARD(keys[i][lane]);
+    }
+  }
+}
+/********************************************************************
+* sortKeys is the scalar kernel of pokerSortHands, a loop over the lanes
+* the compiler can vectorize
+*
+* No returns, sorts every column of keys[][]
+********************************************************************/
+static void sortKeys(uint8_t keys[HAND_SIZE][SORT_LANES])
+{ uint8_t low;
+  int lane;
+  SORT_FIVE(LANE_COMPARE_SWAP,keys);
+}
+#if defined(X86_KERNELS)
+/********************************************************************
+* sortKeysAvx2 is the AVX2 kernel of pokerSortHands, one byte MIN and
+* MAX across a vector per compare-exchange
+*
+* No returns, sorts every column of keys[][]
+********************************************************************/
+static AVX2_TARGET void sortKeysAvx2(uint8_t keys[HAND_SIZE][SORT_LANES])
+{ __m256i rows[HAND_SIZE], low;
+  int i;
+  for(i=0; i<HAND_SIZE; ++i) rows[i]=_mm256_loadu_si256((const __m256i *)keys[i]);
+  SORT_FIVE(VECTOR_COMPARE_SWAP,rows);
+  for(i=0; i<HAND_SIZE; ++i) _mm256_storeu_si256((__m256i *)keys[i],rows[i]);
+}
+#endif
+/********************************************************************
+* pokerReferenceHandRank fills handID[] with the Major and minor ranks
+* of mask. Major rank is most critical and gets an integer
+* from 1-9. Better hands have higher integer values:
+* 1 ~ High card (Junk) : Minor rank is high card
+* 2 ~ One pair         : Minor rank is pair rank
+* 3 ~ Two pair         : Minor ranks are both pair ranks
+* 4 ~ Three of a kind  : Minor rank is 3 of a kind rank
+* 5 ~ Straight         : Minor rank is high card
+* 6 ~ Flush            : Minor rank is high card
+* 7 ~ Full house       : Minor rank is three of a kind rank
+* 8 ~ Four of a kind   : Minor rank is four of a kind rank
+* 9 ~ Straight Flush   : Minor rank is high card
+*
+* handID[] is a 3 digit identification number
+*   Digit 1 ~ Major Rank ~ Pair, Full House, etc. ~ values 1-9
+*   Digit 2 ~ Minor Rank ~ Different for different Major Ranks,
+*             takes values of integer card ranks.
+*   Digit 3 ~ Two Pair Rank ~ 0 if not a Two pair, otherwise holds
+*             the card rank of the lower pair of the two.
+*   Example: 590 ~ Straight with high card 9
+*
+* This is the reference classifier, it reads the mask through the
+* "isSomething" functions. The lookup tables are built from it and
+* checked against it by pokerVerifyHandTables, pokerGetHandRank is the
+* fast path.
+*
+* No returns, takes the mask and the DIGITS_IN_POKER_HAND_ID digits
+* to fill
+********************************************************************/
+void pokerReferenceHandRank(uint64_t mask, int handID[])
+{ int straightMinorRank, flushMinorRank, tempMinorRank;
+  //Default is that two pair digit is zero, unless the hand is a two pair
+  //Apologizing now for code golf
+  handID[LOW_PAIR_DIGIT]=0;
+  straightMinorRank = isStraight(mask);
+  flushMinorRank = isFlush(mask);
+  if((flushMinorRank!=0) && (straightMinorRank!=0))
+  { handID[MAJOR_RANK_DIGIT]=STRAIGHT_FLUSH;
+    handID[MINOR_RANK_DIGIT]=straightMinorRank;
+  }
+  else if((tempMinorRank=isXOfAKind(mask,4))!=0)
+  { handID[MAJOR_RANK_DIGIT]=FOUR_OF_A_KIND;
+    handID[MINOR_RANK_DIGIT]=tempMinorRank;
+  }
+  else if((tempMinorRank=isFullHouse(mask))!=0)
+  { handID[MAJOR_RANK_DIGIT]=FULL_HOUSE;
+    handID[MINOR_RANK_DIGIT]=tempMinorRank;
+  }
+  else if(flushMinorRank!=0)
+  { handID[MAJOR_RANK_DIGIT]=FLUSH;
+    handID[MINOR_RANK_DIGIT]=flushMinorRank;
+  }
+  else if(straightMinorRank!=0)
+  { handID[MAJOR_RANK_DIGIT]=STRAIGHT;
+    handID[MINOR_RANK_DIGIT]=straightMinorRank;
+  }
+  else if((tempMinorRank=isXOfAKind(mask,3))!=0)
+  { handID[MAJOR_RANK_DIGIT]=THREE_OF_A_KIND;
+    handID[MINOR_RANK_DIGIT]=tempMinorRank;
+  }
+  else if((tempMinorRank=isTwoPair(mask))!=0)
+  { handID[MAJOR_RANK_DIGIT]=TWO_PAIR;
+    handID[MINOR_RANK_DIGIT]=tempMinorRank;
+    handID[LOW_PAIR_DIGIT]=isXOfAKind(mask,2);
+  }
+  else if((tempMinorRank=isXOfAKind(mask,2))!=0)
+  { handID[MAJOR_RANK_DIGIT]=ONE_PAIR;
+    handID[MINOR_RANK_DIGIT]=tempMinorRank;
+  }
+  else
+  { handID[MAJOR_RANK_DIGIT]=HIGH_CARD;
+    handID[MINOR_RANK_DIGIT]=highCard(mask);
+  }
+
+}
+/********************************************************************
+* pokerReferenceIsBetterHand compares the major and minor ranks stored
+* in handID to those of mask. It implements
+* a switch so that cases that are ruled out for a better hand are not
+* checked. For example, if we know the original hand was a straight,
+* we need not check if the new hand is a pair, that would not yield
+* a better hand.
+*
+* Reference implementation, pokerIsBetterHand gives the same answer with
+* one table evaluation and an integer compare.
+*
+* Returns TRUE if a better hand was drawn, FALSE otherwise
+* Takes the drawn hand and the pokerReferenceHandRank digits of the old
+* one
+********************************************************************/
+int pokerReferenceIsBetterHand (uint64_t mask, const int handID[])
+{ int majorRank = handID[MAJOR_RANK_DIGIT];
+  int minorRank = handID[MINOR_RANK_DIGIT];
+  int tempMinor, straightMinorRank=0, flushMinorRank=0,  betterHandDetected=FALSE;
+
+  switch (majorRank)
+  { case HIGH_CARD:
+      //printf("entered high card switch\n");
+      if(highCard(mask)>minorRank)
+      { betterHandDetected=TRUE;
+        break;
+      }
+    case ONE_PAIR:
+      //printf("entered one pair switch\n");
+      tempMinor = isXOfAKind(mask,2);
+      //Check if new hand is One Pair
+      if(tempMinor!=0)
+      { if(ONE_PAIR>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else
+        { if(tempMinor>minorRank)
+          { betterHandDetected=TRUE;
+            break;
+          }
+        }
+      }
+    case TWO_PAIR:
+      //printf("Entered two pair switch\n");
+      tempMinor = isTwoPair(mask);
+      if(tempMinor!=0)
+      { if(TWO_PAIR>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else
+        { if(tempMinor>minorRank)
+          { betterHandDetected=TRUE;
+            break;
+          }
+          //ONLY REACHED IF 1ST PAIR MATCHES
+          else if(tempMinor==minorRank)
+          { //Looks at 1st pair ranks
+            if(isXOfAKind(mask,2)>handID[LOW_PAIR_DIGIT])
+            { betterHandDetected=TRUE;
+              break;
+            }
+          }
+        }
+      }
+    case THREE_OF_A_KIND:
+      //printf("entered three of a kind switch\n");
+      tempMinor = isXOfAKind(mask,3);
+      if(tempMinor!=0)
+      { if(THREE_OF_A_KIND>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else if(tempMinor>minorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+      }
+    case STRAIGHT:
+      straightMinorRank = isStraight(mask);
+      //printf("entered straight switch\n");
+      if(straightMinorRank!=0)
+      { if(STRAIGHT>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else if(straightMinorRank>minorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+      }
+    case FLUSH:
+      //printf("entered flush switch\n");
+      flushMinorRank = isFlush(mask);
+      if(flushMinorRank!=0)
+      { if(FLUSH>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else if(flushMinorRank>minorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+      }
+    case FULL_HOUSE:
+      //printf("entered full house switch\n");
+      tempMinor = isFullHouse(mask);
+      if(tempMinor!=0)
+      { if(FULL_HOUSE>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else if(tempMinor>minorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+      }
+    case FOUR_OF_A_KIND:
+      tempMinor = isXOfAKind(mask,4);
+      //printf("entered four of a kind switch\n");
+      if(tempMinor!=0)
+      { if(FOUR_OF_A_KIND>majorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+        else if(tempMinor>minorRank)
+        { betterHandDetected=TRUE;
+          break;
+        }
+      }
+    case STRAIGHT_FLUSH:
+      //printf("entered straight flush switch\n");
+      //in the case that isStraight and isFlush have not been called
+      if(straightMinorRank==0)
+      { straightMinorRank=isStraight(mask);
+      }
+      if(flushMinorRank==0)
+      { flushMinorRank=isFlush(mask);
+      }
+      if(straightMinorRank!=0 && flushMinorRank!=0)
+      { if(majorRank==STRAIGHT_FLUSH)
+        { if(straightMinorRank>minorRank)
+            { betterHandDetected=TRUE;
+              break;
+            }
+        }
+        else
+        { betterHandDetected=TRUE;
+          break;
+        }
+      }
+  }
+  return betterHandDetected;
+}
+/********************************************************************
+* pokerGetHandRank scores a hand through the lookup tables. A score runs
+* from 1 (7 5 4 3 2) to HAND_CLASS_COUNT (royal flush) and orders
+* every hand, kickers included, so hands of equal strength get equal
+* scores.
+*
+* Returns the score, takes the card mask of the hand
+********************************************************************/
+int pokerGetHandRank(uint64_t mask)
+{ return pokerEvaluateHand(mask);
+}
+/********************************************************************
+* pokerIsBetterHand compares mask against the score of another hand.
+* Scores are totally ordered, so a better hand is
+* exactly a larger score, kickers included, and equal hands tie.
+*
+* Returns TRUE if a better hand was drawn, FALSE otherwise
+* Takes the drawn hand and the score it has to beat
+********************************************************************/
+int pokerIsBetterHand(uint64_t mask, int score)
+{ return pokerEvaluateHand(mask)>score;
+}
+/********************************************************************
+* pokerEvaluateHand maps a HAND_SIZE card mask to its score. The rank
+* key of the hand picks the non-flush score out of rankTable, and a suit
+* field holding the whole hand picks its flush score out of
+* flushTable. A flush always beats the same ranks unsuited, so the
+* larger of the lookups is the answer and no branch is needed.
+*
+* Returns the score, takes the card mask of the hand
+********************************************************************/
+int pokerEvaluateHand(uint64_t mask)
+{ int c=SUIT_RANKS(mask,0), d=SUIT_RANKS(mask,1);
+  int h=SUIT_RANKS(mask,2), s=SUIT_RANKS(mask,3);
+  int score=rankTable[suitRankKey[c]+suitRankKey[d]+suitRankKey[h]+suitRankKey[s]];
+  score=MAX(score,flushTable[c]);
+  score=MAX(score,flushTable[d]);
+  score=MAX(score,flushTable[h]);
+  return MAX(score,flushTable[s]);
+}
+/********************************************************************
+* pokerEvaluateSevenCards maps a MAX_HAND_CARDS card mask to the score
+* of its best five cards without trying any of them. The seven card rank
+* key picks the best score without a flush out of sevenRankTable, and
+* flushTable holds the best flush of every suit field of five to seven
+* cards. Seven cards hold at most one such field, and a flush can lose
+* to a full house or quads the ranks make, so the larger lookup wins
+* like in pokerEvaluateHand. pokerInitSevenCards has to have run.
+*
+* Returns the score, takes the card mask of the hand
+********************************************************************/
+int pokerEvaluateSevenCards(uint64_t mask)
+{ int c=SUIT_RANKS(mask,0), d=SUIT_RANKS(mask,1);
+  int h=SUIT_RANKS(mask,2), s=SUIT_RANKS(mask,3);
+  int score=sevenRankTable[suitSevenKey[c]+suitSevenKey[d]+suitSevenKey[h]+suitSevenKey[s]];
+  score=MAX(score,flushTable[c]);
+  score=MAX(score,flushTable[d]);
+  score=MAX(score,flushTable[h]);
+  return MAX(score,flushTable[s]);
+}
+/********************************************************************
+* pokerEvaluateSixCards is pokerEvaluateSevenCards for six cards: the
+* six card rank key picks the best score without a flush out of
+* sixRankTable, and flushTable covers six card suit fields.
+* pokerInitVariant or pokerInitSevenCards has to have run.
+*
+* Returns the score, takes the card mask of the hand
+********************************************************************/
+int pokerEvaluateSixCards(uint64_t mask)
+{ int c=SUIT_RANKS(mask,0), d=SUIT_RANKS(mask,1);
+  int h=SUIT_RANKS(mask,2), s=SUIT_RANKS(mask,3);
+  int score=sixRankTable[suitSixKey[c]+suitSixKey[d]+suitSixKey[h]+suitSixKey[s]];
+  score=MAX(score,flushTable[c]);
+  score=MAX(score,flushTable[d]);
+  score=MAX(score,flushTable[h]);
+  return MAX(score,flushTable[s]);
+}
+/********************************************************************
+* SHORT_DECK_EVALUATOR defines the short deck evaluator of one hand
+* size. RANK_SCORE is the standard score of the best hand without a
+* flush, out of the suit fields c, d, h and s. shortScore maps it to
+* the short deck order, which keeps the order within every major rank
+* so the best standard hand stays the best. Only A 6 7 8 9 moves up,
+* and a mask holding it is raised to shortWheel without a branch.
+* Flushes come straight out of shortFlushTable.
+********************************************************************/
+#define SHORT_DECK_EVALUATOR(name,RANK_SCORE) \
+static int name(uint64_t mask) \
+{ int c=SUIT_RANKS(mask,0), d=SUIT_RANKS(mask,1); \
+  int h=SUIT_RANKS(mask,2), s=SUIT_RANKS(mask,3); \
+  int score=shortScore[RANK_SCORE]; \
+  score=MAX(score,shortWheel & -HAS_SHORT_WHEEL(c|d|h|s)); \
+  score=MAX(score,shortFlushTable[c]); \
+  score=MAX(score,shortFlushTable[d]); \
+  score=MAX(score,shortFlushTable[h]); \
+  return MAX(score,shortFlushTable[s]); \
+}
+SHORT_DECK_EVALUATOR(evaluateShortFive,
+                     rankTable[suitRankKey[c]+suitRankKey[d]+suitRankKey[h]+suitRankKey[s]])
+SHORT_DECK_EVALUATOR(evaluateShortSix,
+                     sixRankTable[suitSixKey[c]+suitSixKey[d]+suitSixKey[h]+suitSixKey[s]])
+SHORT_DECK_EVALUATOR(evaluateShortSeven,
+                     sevenRankTable[suitSevenKey[c]+suitSevenKey[d]+suitSevenKey[h]
+                                    +suitSevenKey[s]])
+/********************************************************************
+* pokerGetBestHandRank scores the best five cards of a HOLDEM_MIN_CARDS
+* to MAX_HAND_CARDS card mask, through the standard deck entry of the
+* variant dispatch table for its size. Seven cards need
+* pokerInitSevenCards to have run.
+*
+* Returns the score, takes the card mask of the hand
+********************************************************************/
+int pokerGetBestHandRank(uint64_t mask)
+{ return VARIANTS[VARIANT(STANDARD_DECK,POPCOUNT(mask))].evaluate(mask);
+}
+/********************************************************************
+* initHandState sets up a HandState for the cards of mask
+*
+* No returns, takes the state to fill and the cards
+********************************************************************/
+static void initHandState(HandState *state, uint64_t mask)
+{ int suit;
+  state->mask=mask;
+  state->rankKey=0;
+  for(suit=0; suit<SUIT_COUNT; ++suit)
+  { state->suitFields[suit]=SUIT_RANKS(mask,suit);
+    state->rankKey+=suitRankKey[state->suitFields[suit]];
+  }
+  state->lastSuit=0;
+}
+/********************************************************************
+* addCard puts one card into a HandState. The rank key moves by the
+* card's RANK_KEY and one suit field gains a bit, nothing is sorted
+* or searched.
+*
+* No returns, takes the state and the bit index of a card not in it
+********************************************************************/
+static void addCard(HandState *state, int card)
+{ int rank=card%RANK_COUNT, suit=card/RANK_COUNT;
+  state->mask|=(uint64_t)1<<card;
+  state->rankKey+=RANK_KEY[rank];
+  state->suitFields[suit]|=1<<rank;
+  state->lastSuit=suit;
+}
+/********************************************************************
+* removeCard takes one card out of a HandState, undoing addCard
+*
+* No returns, takes the state and the bit index of a card in it
+********************************************************************/
+static void removeCard(HandState *state, int card)
+{ int rank=card%RANK_COUNT, suit=card/RANK_COUNT;
+  state->mask&=~((uint64_t)1<<card);
+  state->rankKey-=RANK_KEY[rank];
+  state->suitFields[suit]&=~(1<<rank);
+}
+/********************************************************************
+* handStateScore scores a full HandState. The rank key gives the score
+* without suits. A flush needs every card in one suit, the card added
+* last included, so only the field of lastSuit can be a flush and the
+* other three are never looked at.
+*
+* Returns the score of the hand, takes a state holding HAND_SIZE cards
+********************************************************************/
+static int handStateScore(const HandState *state)
+{ return MAX(rankTable[state->rankKey],flushTable[state->suitFields[state->lastSuit]]);
+}
+/********************************************************************
+* referenceHandKey gives the hand in mask an integer that orders
+* hands fully but sparsely: the major rank from pokerReferenceHandRank
+* in the top bits, then 4 bits per rank with ranks held by more cards
+* first and higher ranks first among equals. Straights only carry
+* their high card, which is 5 for the wheel.
+*
+* Returns the key, takes the card mask of the hand
+********************************************************************/
+static int referenceHandKey(uint64_t mask)
+{ int handID[DIGITS_IN_POKER_HAND_ID], key, count, ranks, group;
+  pokerReferenceHandRank(mask,handID);
+  key=handID[MAJOR_RANK_DIGIT];
+  if(key==STRAIGHT || key==STRAIGHT_FLUSH)
+  { return (key<<HAND_KEY_RANK_BITS)|isStraight(mask);
+  }
+  for(count=SUIT_COUNT; count>0; --count)
+  { group=ranksWithAtLeast(mask,count);
+    if(count<SUIT_COUNT) group&=~ranksWithAtLeast(mask,count+1);
+    for(ranks=group; ranks!=0; ranks&=~(1<<HIGHEST_BIT(ranks)))
+    { key=(key<<4)|(HIGHEST_BIT(ranks)+2);
+    }
+  }
+  //Pad so every hand carries the same number of rank digits
+  for(count=POPCOUNT(rankUnion(mask)); count<HAND_SIZE; ++count) key<<=4;
+  return key;
+}
+/********************************************************************
+* compareInts orders two ints for qsort and bsearch
+********************************************************************/
+static int compareInts(const void *a, const void *b)
+{ int x=*(const int *)a, y=*(const int *)b;
+  return (x>y)-(x<y);
+}
+/********************************************************************
+* compareWords orders two uint64_t for qsort
+********************************************************************/
+static int compareWords(const void *a, const void *b)
+{ uint64_t x=*(const uint64_t *)a, y=*(const uint64_t *)b;
+  return (x>y)-(x<y);
+}
+/********************************************************************
+* keyToScore finds the score of a referenceHandKey, its place among
+* the sorted keys of every hand class.
+*
+* Returns the score, or 0 if the key is not a hand class
+********************************************************************/
+static int keyToScore(int key)
+{ int *found=bsearch(&key,handClassKey+1,HAND_CLASS_COUNT,sizeof(int),compareInts);
+  return (found!=NULL) ? (int)(found-handClassKey) : 0;
+}
+/********************************************************************
+* dealRanks builds an unsuited hand out of HAND_SIZE ranks given in
+* non-decreasing order. The nth copy of a rank goes into the nth suit,
+* and distinct ranks get one card moved out of the first suit so the
+* hand is never a flush.
+*
+* Returns the card mask of the hand, 0 for five of a kind
+* Takes the rank indexes, and fills *key with the hand's rank key
+********************************************************************/
+static uint64_t dealRanks(const int ranks[], int *key)
+{ int i, counts[RANK_COUNT];
+  uint64_t mask=0;
+  memset(counts,0,sizeof(counts));
+  *key=0;
+  for(i=0; i<HAND_SIZE; ++i)
+  { if(counts[ranks[i]]==SUIT_COUNT) return 0;
+    mask|=CARD_BIT(ranks[i],counts[ranks[i]]);
+    ++counts[ranks[i]];
+    *key+=RANK_KEY[ranks[i]];
+  }
+  if(POPCOUNT(SUIT_RANKS(mask,0))==HAND_SIZE)
+  { mask^=CARD_BIT(ranks[0],0)|CARD_BIT(ranks[0],1);
+  }
+  return mask;
+}
+/********************************************************************
+* nextRankSequence steps ranks[] like an odometer through every
+* non-decreasing sequence of size rank indexes: the last rank that
+* can still grow is bumped and everything after it restarts from that
+* same rank.
+*
+* Returns FALSE once every sequence has been visited, TRUE otherwise
+********************************************************************/
+static int nextRankSequence(int ranks[], int size)
+{ int i, j;
+  for(i=size-1; i>0 && ranks[i]==RANK_COUNT-1; --i);
+  ++ranks[i];
+  for(j=i+1; j<size; ++j) ranks[j]=ranks[i];
+  return ranks[0]<RANK_COUNT;
+}
+/********************************************************************
+* buildHandTables fills suitRankKey, rankTable, flushTable,
+* handClassKey and scoreCategory once, from pokerInit. Every multiset
+* of HAND_SIZE ranks (at most 4 of a rank) is dealt as an unsuited hand
+* and every 5 bit suit field as a flush, each of the HAND_CLASS_COUNT
+* classes exactly once. Their reference keys are sorted together with
+* the table entry each one fills, so the place of a key in that order
+* is stored straight into its entry and no hand is classified twice.
+* Fields of up to MAX_HAND_CARDS bits then get their best 5 bit flush.
+*
+* Returns FALSE if two rank multisets share a key or there is no
+* memory, TRUE otherwise
+********************************************************************/
+static int buildHandTables(void)
+{ int ranks[HAND_SIZE];
+  int i, key, field, classCount=0;
+  uint64_t mask, *classes;
+  //High half the reference key, low half the flushTable field or the
+  //rankTable key past SUIT_MASK_COUNT
+  if((classes=malloc((HAND_CLASS_COUNT+1)*sizeof(uint64_t)))==NULL) return FALSE;
+  for(field=0; field<SUIT_MASK_COUNT; ++field)
+  { suitRankKey[field]=0;
+    for(i=0; i<RANK_COUNT; ++i)
+    { if(field & (1<<i)) suitRankKey[field]+=RANK_KEY[i];
+    }
+    flushTable[field]=0;
+    if(POPCOUNT(field)==HAND_SIZE)
+    { classes[classCount++]=(uint64_t)referenceHandKey((uint64_t)field)<<32 | field;
+    }
+  }
+  memset(rankTable,0,sizeof(rankTable));
+  memset(ranks,0,sizeof(ranks));
+  do
+  { if((mask=dealRanks(ranks,&key))!=0)
+    { if(rankTable[key]!=0 || classCount==HAND_CLASS_COUNT)
+      { free(classes);
+        return FALSE;
+      }
+      rankTable[key]=TRUE;
+      classes[classCount++]=(uint64_t)referenceHandKey(mask)<<32 | (SUIT_MASK_COUNT+key);
+    }
+  }while(nextRankSequence(ranks,HAND_SIZE)==TRUE);
+  if(classCount!=HAND_CLASS_COUNT)
+  { free(classes);
+    return FALSE;
+  }
+  qsort(classes,HAND_CLASS_COUNT,sizeof(uint64_t),compareWords);
+  categoryFloor[STRAIGHT_FLUSH+1]=HAND_CLASS_COUNT+1;
+  for(i=HAND_CLASS_COUNT; i>=1; --i)
+  { handClassKey[i]=classes[i-1]>>32;
+    scoreCategory[i]=handClassKey[i]>>HAND_KEY_RANK_BITS;
+    categoryFloor[scoreCategory[i]]=i;
+    key=(int)(classes[i-1] & 0xFFFFFFFF);
+    if(key<SUIT_MASK_COUNT) flushTable[key]=i;
+    else rankTable[key-SUIT_MASK_COUNT]=i;
+  }
+  free(classes);
+  //A field with one bit less is a smaller number, so it is done first
+  for(field=0; field<SUIT_MASK_COUNT; ++field)
+  { if(POPCOUNT(field)<=HAND_SIZE || POPCOUNT(field)>MAX_HAND_CARDS) continue;
+    for(i=field; i!=0; i&=i-1)
+    { flushTable[field]=MAX(flushTable[field],flushTable[field & ~(i & -i)]);
+    }
+  }
+  return TRUE;
+}
+/********************************************************************
+* pokerVerifyHandTables runs every one of the C(52,5) hands through both
+* pokerEvaluateHand and the reference classifier and counts any
+* disagreement in score or in major rank. pokerInit has to have run.
+*
+* Returns the number of mismatches, *hands gets the hands checked
+********************************************************************/
+int pokerVerifyHandTables(int *hands)
+{ int handID[DIGITS_IN_POKER_HAND_ID], a, b, c, d, e, mismatches=0, score, key;
+  uint64_t mask;
+  *hands=0;
+  for(a=0; a<DECK_SIZE; ++a)
+  for(b=a+1; b<DECK_SIZE; ++b)
+  for(c=b+1; c<DECK_SIZE; ++c)
+  for(d=c+1; d<DECK_SIZE; ++d)
+  for(e=d+1; e<DECK_SIZE; ++e)
+  { mask=((uint64_t)1<<a)|((uint64_t)1<<b)|((uint64_t)1<<c)
+        |((uint64_t)1<<d)|((uint64_t)1<<e);
+    score=pokerEvaluateHand(mask);
+    key=referenceHandKey(mask);
+    pokerReferenceHandRank(mask,handID);
+    if(score!=keyToScore(key)
+       || scoreCategory[score]!=handID[MAJOR_RANK_DIGIT]) ++mismatches;
+    ++*hands;
+  }
+  return mismatches;
+}
+/********************************************************************
+* pokerVerifySevenCardTables runs every one of the C(52,7) hands through
+* pokerEvaluateSevenCards and checks it against the best of its 21 five
+* card hands through pokerEvaluateHand, which pokerVerifyHandTables
+* checks. pokerInitSevenCards has to have run.
+*
+* Returns the number of mismatches, *hands gets the hands checked
+********************************************************************/
+int pokerVerifySevenCardTables(int *hands)
+{ int cardBits[MAX_HAND_CARDS], i, j, best, mismatches=0;
+  uint64_t mask;
+  *hands=0;
+  for(i=0; i<MAX_HAND_CARDS; ++i) cardBits[i]=i;
+  do
+  { for(mask=0, i=0; i<MAX_HAND_CARDS; ++i) mask|=(uint64_t)1<<cardBits[i];
+    for(best=0, i=0; i<MAX_HAND_CARDS; ++i)
+    { for(j=i+1; j<MAX_HAND_CARDS; ++j)
+      { best=MAX(best,pokerEvaluateHand(mask & ~((uint64_t)1<<cardBits[i]
+                                                 | (uint64_t)1<<cardBits[j])));
+      }
+    }
+    if(pokerEvaluateSevenCards(mask)!=best) ++mismatches;
+    ++*hands;
+  }while(nextCombination(cardBits,MAX_HAND_CARDS,DECK_SIZE)==TRUE);
+  return mismatches;
+}
+/********************************************************************
+* pokerVerifyVariants checks the variant evaluators that
+* pokerVerifyHandTables and pokerVerifySevenCardTables do not: six
+* standard cards, and five to seven short deck cards, on every hand of
+* their deck. Five short deck cards are checked against the short deck
+* key of the reference classifier, six and seven against the best of
+* their five card hands.
+*
+* Returns the number of mismatches, or -1 if the tables of a variant
+* could not be built, *hands gets the hands checked
+********************************************************************/
+int pokerVerifyVariants(int *hands)
+{ const PokerVariant *variant;
+  int places[MAX_HAND_CARDS], deckCards[DECK_SIZE];
+  int index, i, deckCount, mismatches=0;
+  uint64_t mask, cards;
+  *hands=0;
+  for(index=VARIANT(STANDARD_DECK,HAND_SIZE+1); index<VARIANT_COUNT; ++index)
+  { if(index==VARIANT(STANDARD_DECK,MAX_HAND_CARDS)) continue;
+    if(pokerInitVariant(index,&variant)!=POKER_OK) return -1;
+    for(deckCount=0, cards=variant->deckMask; cards!=0; cards&=cards-1)
+    { deckCards[deckCount++]=__builtin_ctzll(cards);
+    }
+    for(i=0; i<variant->cards; ++i) places[i]=i;
+    do
+    { for(mask=0, i=0; i<variant->cards; ++i) mask|=(uint64_t)1<<deckCards[places[i]];
+      if(variant->evaluate(mask)!=referenceVariantScore(variant,mask)) ++mismatches;
+      ++*hands;
+    }while(nextCombination(places,variant->cards,deckCount)==TRUE);
+  }
+  return mismatches;
+}
+/********************************************************************
+* referenceVariantScore scores a hand of a variant the slow way. Five
+* short deck cards find their shortDeckKey among shortClassKey, more
+* cards take the best of every five card hand through the variant's
+* five card evaluator.
+*
+* Returns the score, 0 for a short deck hand without a class
+* Takes the variant and the card mask of the hand
+********************************************************************/
+static int referenceVariantScore(const PokerVariant *variant, uint64_t mask)
+{ const PokerVariant *five=&VARIANTS[VARIANT(variant->deck,HAND_SIZE)];
+  uint64_t first, second;
+  int key, score=0, *found;
+  if(variant->cards==HAND_SIZE)
+  { key=shortDeckKey(referenceHandKey(mask));
+    found=bsearch(&key,shortClassKey+1,SHORT_CLASS_COUNT,sizeof(int),compareInts);
+    return (found!=NULL) ? (int)(found-shortClassKey) : 0;
+  }
+  for(first=mask; first!=0; first&=first-1)
+  { if(variant->cards==HAND_SIZE+1)
+    { score=MAX(score,five->evaluate(mask & ~(first & -first)));
+      continue;
+    }
+    for(second=first & (first-1); second!=0; second&=second-1)
+    { score=MAX(score,five->evaluate(mask & ~(first & -first) & ~(second & -second)));
+    }
+  }
+  return score;
+}
+/********************************************************************
+* rankUnion ORs the four suit fields of mask together, giving a
+* 13 bit mask of every rank present in the hand.
+*
+* Returns the rank mask, takes the card mask
+********************************************************************/
+static int rankUnion(uint64_t mask)
+{ return SUIT_RANKS(mask,0) | SUIT_RANKS(mask,1)
+       | SUIT_RANKS(mask,2) | SUIT_RANKS(mask,3);
+}
+/********************************************************************
+* ranksWithAtLeast builds the 13 bit mask of ranks held by at least
+* x cards of mask. A rank has x cards when it shows up in x of
+* the suit fields, so this is an OR over ANDs of x suit fields.
+*
+* Returns the rank mask, takes the card mask and x from 1 to SUIT_COUNT
+********************************************************************/
+static int ranksWithAtLeast(uint64_t mask, int x)
+{ int c=SUIT_RANKS(mask,0), d=SUIT_RANKS(mask,1);
+  int h=SUIT_RANKS(mask,2), s=SUIT_RANKS(mask,3);
+  switch(x)
+  { case 1:
+      return c|d|h|s;
+    case 2:
+      return (c&d)|(c&h)|(c&s)|(d&h)|(d&s)|(h&s);
+    case 3:
+      return (c&d&h)|(c&d&s)|(c&h&s)|(d&h&s);
+    default:
+      return c&d&h&s;
+  }
+}
+/********************************************************************
+* HERE BEGINS THE SLEW OF "isSomething" FUNCTIONS.
+* They all read a card mask, card order does not matter to any of them.
+********************************************************************/
+
+/********************************************************************
+* isFlush determines whether or not all the suits of a hand match,
+* which is the case when one suit field holds all HAND_SIZE cards
+*
+* Returns a the value of the minor rank, in this case we will use the
+* sum of the card ranks, 0 if not a flush
+* Takes the card mask
+********************************************************************/
+static int isFlush(uint64_t mask)
+{ int i, ranks, flushSum=0; //default false
+  for(i=0; i<SUIT_COUNT; ++i)
+  { ranks=SUIT_RANKS(mask,i);
+    if(POPCOUNT(ranks)==HAND_SIZE)
+    { while(ranks!=0)
+      { flushSum+=LOWEST_BIT(ranks)+2;
+        ranks&=ranks-1;
+      }
+    }
+  }
+  return flushSum;
+}
+/********************************************************************
+* isStraight determines whether or not the hand is of rank straight.
+* A straight occurs when the ranks of your cards can be arranged in
+* a contiguous order. EX: 8 9 10 J Q / 8 9 10 11 12
+* There is a special straight that is the sequence 2 3 4 5 A.
+* With a rank mask this is five distinct ranks that are a shifted
+* run of five bits.
+*
+* Returns high card in straight if it is a straight, otherwise 0
+* Takes the card mask
+********************************************************************/
+static int isStraight(uint64_t mask)
+{ int ranks=rankUnion(mask), lowRank;
+  if(ranks==WHEEL_RANKS) return 5;
+  lowRank=LOWEST_BIT(ranks);
+  if(ranks==(STRAIGHT_RANKS<<lowRank)) return lowRank+HAND_SIZE+1;
+  return 0;
+}
+/********************************************************************
+* isXOfAKind determines whether or not X cards in the hand all
+* share a rank. When x=4 this is the 2nd highest ranking hand.
+*
+* Returns the lowest rank held by at least x cards, otherwise 0
+* Takes the card mask and an integer x that corresponds to the # of
+* matching ranks desired.
+********************************************************************/
+static int isXOfAKind(uint64_t mask, int x)
+{ int ranks=ranksWithAtLeast(mask,x);
+  return (ranks!=0) ? LOWEST_BIT(ranks)+2 : 0;
+}
+/********************************************************************
+* isFullHouse determine if the hand has a 3 of a kind AND a pair,
+* where each occurs in a unique rank. EX: 5 5 A A A
+*
+* Returns the minor rank of the three of a kind in the full house
+* if a full house is found, otherwise 0.
+********************************************************************/
+static int isFullHouse(uint64_t mask)
+{ int triplets=ranksWithAtLeast(mask,3);
+  int pairs=ranksWithAtLeast(mask,2) & ~triplets;
+  if(POPCOUNT(triplets)==1 && POPCOUNT(pairs)==1)
+  { return LOWEST_BIT(triplets)+2;
+  }
+  return 0;
+}
+/********************************************************************
+* isTwoPair determines if two pairs occur in the ranks of the hand.
+* Ex: Q Q J J 2
+*
+* Returns the card rank of the higher pair if found, and 0 otherwise
+********************************************************************/
+static int isTwoPair(uint64_t mask)
+{ int pairs=ranksWithAtLeast(mask,2) & ~ranksWithAtLeast(mask,3);
+  return (POPCOUNT(pairs)==2) ? HIGHEST_BIT(pairs)+2 : 0;
+}
+/********************************************************************
+* highCard determines the highest ranking card in the hand. This
+* will be useful for comparing the relative superiority of hands with
+* an identical rank. EX: 8 8 10 10 A  vs. 8 8 J J 3, 2nd hand wins
+* because J>10 in rank. (MINOR RANKS)
+*
+* Returns ranking of high card in integer mapping.
+********************************************************************/
+static int highCard(uint64_t mask)
+{ return HIGHEST_BIT(rankUnion(mask))+2;
+}
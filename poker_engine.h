@@ -0,0 +1,279 @@
+/********************************************************************
+* Poker Hand Probability Engine
+*
+* Everything that works out the probabilities of a hand lives behind
+* this header, so the program on top of it is only input and output.
+* No call keeps state outside the PokerContext it was handed. The
+* lookup tables every context reads are built once by pokerInit and
+* never written again, so any number of threads can each run their
+* own context at the same time.
+*
+* Typical use:
+*   PokerOptions options;
+*   PokerContext *context;
+*   pokerInitOptions(&options);
+*   if(pokerCreateContext(&options,&context)==POKER_OK)
+*   { pokerEvaluateHands(context,hands,count,results);
+*     pokerDestroyContext(context);
+*   }
+********************************************************************/
+#ifndef POKER_ENGINE_H
+#define POKER_ENGINE_H
+#include <stdint.h>
+//Every public macro carries POKER_ and every function and type poker
+//or Poker, and nothing else of the engine is visible to the linker,
+//so the header and the object can be embedded
+#define POKER_DECK_SIZE        52
+#define POKER_HAND_SIZE        5
+//POKER_HOLDEM_MODE hands: two hole cards and a flop, turn or river
+#define POKER_HOLDEM_MIN_CARDS 5
+#define POKER_MAX_HAND_CARDS   7
+#define POKER_SUIT_COUNT       4
+#define POKER_RANK_COUNT       13
+#define POKER_FALSE            0
+#define POKER_TRUE             1
+#define POKER_HIGH_CARD        1
+#define POKER_ONE_PAIR         2
+#define POKER_TWO_PAIR         3
+#define POKER_THREE_OF_A_KIND  4
+#define POKER_STRAIGHT         5
+#define POKER_FLUSH            6
+#define POKER_FULL_HOUSE       7
+#define POKER_FOUR_OF_A_KIND   8
+#define POKER_STRAIGHT_FLUSH   9
+//Major ranks, index category-POKER_HIGH_CARD
+#define POKER_CATEGORY_COUNT   9
+#define POKER_HAND_ID_DIGITS   3
+#define POKER_MAJOR_RANK_DIGIT 0
+#define POKER_MINOR_RANK_DIGIT 1
+#define POKER_LOW_PAIR_DIGIT   2
+#define POKER_EXACT_MODE       0
+#define POKER_MONTE_CARLO_MODE 1
+#define POKER_ADAPTIVE_MODE    3
+#define POKER_TABLE_MODE       4
+#define POKER_DRAW_MODE        6
+#define POKER_HOLDEM_MODE      8
+#define POKER_EQUITY_MODE      9
+#define POKER_RANDOM_SAMPLING     0
+#define POKER_STRATIFIED_SAMPLING 1
+#define POKER_SOBOL_SAMPLING      2
+#define POKER_DEFAULT_SAMPLE_NUMBER   750000
+#define POKER_DEFAULT_CACHE_MEGABYTES 16
+#define POKER_MAX_THREADS             256
+//POKER_EQUITY_MODE opponents, every one takes POKER_HAND_SIZE cards
+#define POKER_MAX_OPPONENTS           9
+//Discard subsets of a hand, bit i set when card i is thrown away
+#define POKER_SUBSET_COUNT (1<<POKER_HAND_SIZE)
+//Distinct 5 card hands once suits only matter for flushes
+#define POKER_HAND_CLASS_COUNT 7462
+//Decks of a variant. The short deck drops the 2s to 5s, A 6 7 8 9 is
+//its lowest straight and a flush beats a full house.
+#define POKER_STANDARD_DECK       0
+#define POKER_SHORT_DECK          1
+#define POKER_SHORT_DECK_SIZE     36
+#define POKER_SHORT_DECK_LOW_RANK 4
+//Distinct 5 card hands of the short deck
+#define POKER_SHORT_CLASS_COUNT   1404
+//Variants are every deck with every hand size of 5 to 7 cards
+#define POKER_VARIANT_SIZES (POKER_MAX_HAND_CARDS-POKER_HAND_SIZE+1)
+#define POKER_VARIANT_COUNT (2*POKER_VARIANT_SIZES)
+#define POKER_VARIANT(deck,cards) ((deck)*POKER_VARIANT_SIZES+(cards)-POKER_HAND_SIZE)
+#define POKER_OK              0
+#define POKER_NO_MEMORY       1
+#define POKER_NO_THREADS      2
+#define POKER_TABLES_FAILED   3
+#define POKER_TABLE_UNREADABLE 4
+#define POKER_TABLE_INVALID   5
+#define POKER_TABLE_UNWRITABLE 6
+#define POKER_BAD_OPTIONS     7
+#define POKER_SHARD_MISMATCH  8
+#define POKER_CHECKSUM_MISMATCH 9
+//Bit index of a card in a card mask, suits are 13 bit fields
+#define POKER_CARD(rankIndex,suitIndex) ((suitIndex)*POKER_RANK_COUNT+(rankIndex))
+
+/********************************************************************
+* PokerOptions picks how a context works hands out, pokerInitOptions
+* fills in the defaults.
+*   mode: POKER_EXACT_MODE, POKER_MONTE_CARLO_MODE,
+*     POKER_ADAPTIVE_MODE, POKER_TABLE_MODE, POKER_DRAW_MODE,
+*     POKER_HOLDEM_MODE or POKER_EQUITY_MODE
+*   sampleNumber: draws per discard when sampling, the cap in
+*     POKER_ADAPTIVE_MODE, deals per hand in POKER_EQUITY_MODE
+*   precision: confidence half-width in percentage points that
+*     POKER_ADAPTIVE_MODE stops at
+*   sampling: how the sampled modes pick cards. POKER_RANDOM_SAMPLING
+*     draws them independently, POKER_STRATIFIED_SAMPLING cycles the
+*     first card through the deck and POKER_SOBOL_SAMPLING follows a
+*     randomly shifted Sobol sequence. POKER_ADAPTIVE_MODE stops on the
+*     variance the method actually reaches.
+*   histogram: POKER_TRUE to also count the major rank every discard ends
+*     on and the mean score, in the same pass. POKER_EXACT_MODE,
+*     POKER_MONTE_CARLO_MODE and POKER_ADAPTIVE_MODE only.
+*   opponents: random hands POKER_EQUITY_MODE plays every hand against, 1
+*     to POKER_MAX_OPPONENTS
+*   seed: seed every sample generator is derived from
+*   threadCount: threads that run samples, the calling one included
+*   cacheMegabytes: memory cap of the result cache, 0 for none
+*   tableFile: table file POKER_TABLE_MODE maps
+********************************************************************/
+typedef struct
+{ int  mode;
+  int  sampleNumber;
+  double precision;
+  int  sampling;
+  int  histogram;
+  int  opponents;
+  uint64_t seed;
+  int  threadCount;
+  int  cacheMegabytes;
+  const char *tableFile;
+} PokerOptions;
+/********************************************************************
+* PokerHand is one hand in the order it was given, each card being
+* its bit index POKER_CARD(rank index, suit index). cardCount is
+* POKER_HAND_SIZE, or in POKER_HOLDEM_MODE POKER_HOLDEM_MIN_CARDS to
+* POKER_MAX_HAND_CARDS: the two hole cards and then the board.
+* deadMask holds the bits of the cards known to be out of the deck,
+* burned or exposed, which nothing is drawn from. 0 when every other
+* card is live.
+********************************************************************/
+typedef struct
+{ uint8_t cards[POKER_MAX_HAND_CARDS];
+  uint8_t cardCount;
+  uint64_t deadMask;
+} PokerHand;
+/********************************************************************
+* PokerResult is what pokerEvaluateHands works out for one hand.
+*   status: POKER_TRUE, or POKER_FALSE for a hand with a bad or
+*     repeated card, a dead card in the hand, or too few live cards
+*     left for the mode, in which case nothing else is filled in
+*   score: 1 (7 5 4 3 2) to POKER_HAND_CLASS_COUNT (royal flush), equal
+*     hands get equal scores, of the best five cards in POKER_HOLDEM_MODE
+*   category: major rank of the score, POKER_HIGH_CARD to
+*     POKER_STRAIGHT_FLUSH
+*   probabilities/samplesDrawn: percentage of improving by
+*     discarding each card, in the order of the hand, and the draws
+*     it rests on
+*   variances/effectiveSamples: variance of each probability, as a
+*     fraction, and the number of independent random draws that would
+*     give it. 0 and samplesDrawn when nothing was sampled, not filled
+*     in POKER_DRAW_MODE, POKER_TABLE_MODE or POKER_HOLDEM_MODE.
+*   categoryProbabilities/expectedScores: with the histogram option
+*     only, percentage of ending on every major rank by discarding
+*     each card, and the mean score it ends on
+*   drawImprovement/drawExpectedScore: POKER_DRAW_MODE only, percentage of
+*     improving and mean final score for every discard subset
+*   riverImprovement/riverBoards: POKER_HOLDEM_MODE only, percentage of
+*     the boards dealt out to the river that beat score, and how many
+*     boards there are
+*   winProbability/tieProbability/equity/equityDeals: POKER_EQUITY_MODE
+*     only, percentage of deals the hand beats every opponent in, ties
+*     the best of them in, and its share of the pot with ties split,
+*     over equityDeals random deals
+********************************************************************/
+typedef struct
+{ int  status;
+  int  score;
+  int  category;
+  float probabilities[POKER_HAND_SIZE];
+  int  samplesDrawn[POKER_HAND_SIZE];
+  double variances[POKER_HAND_SIZE];
+  double effectiveSamples[POKER_HAND_SIZE];
+  double categoryProbabilities[POKER_HAND_SIZE][POKER_CATEGORY_COUNT];
+  double expectedScores[POKER_HAND_SIZE];
+  double drawImprovement[POKER_SUBSET_COUNT];
+  double drawExpectedScore[POKER_SUBSET_COUNT];
+  double riverImprovement;
+  int  riverBoards;
+  double winProbability;
+  double tieProbability;
+  double equity;
+  int  equityDeals;
+} PokerResult;
+/********************************************************************
+* PokerStats are the counters of a context.
+*   evaluations: candidate hands scored, exact or sampled
+*   cacheHits/cacheMisses/cacheEvictions: result cache counters
+*   cacheUsed/cacheCapacity: entries filled and entries there is
+*     room for
+********************************************************************/
+typedef struct
+{ uint64_t evaluations;
+  uint64_t cacheHits;
+  uint64_t cacheMisses;
+  uint64_t cacheEvictions;
+  int  cacheUsed;
+  int  cacheCapacity;
+} PokerStats;
+/********************************************************************
+* PokerVariant is one entry of the variant dispatch table, a deck and
+* a hand size with an evaluator built for exactly that pair. Variants
+* only score hands: PokerOptions, pokerEvaluateHands and the program
+* itself still work out probabilities for the standard 52 card deck
+* only, on five card hands and 5 to 7 card hands in POKER_HOLDEM_MODE.
+*   name: "standard-5" ... "short-7"
+*   deck/cards/deckMask: POKER_STANDARD_DECK or POKER_SHORT_DECK, the
+*     cards of a hand and the card mask of the whole deck
+*   classCount: scores run 1 to classCount, the best five cards of a
+*     hand are scored on the same scale for every hand size
+*   evaluate: score of a mask of cards cards out of deckMask
+*   categories[]: major rank of every score
+********************************************************************/
+typedef int (*PokerHandEvaluator)(uint64_t mask);
+typedef struct
+{ const char *name;
+  int  deck;
+  int  cards;
+  uint64_t deckMask;
+  int  classCount;
+  PokerHandEvaluator evaluate;
+  const uint8_t *categories;
+} PokerVariant;
+/********************************************************************
+* PokerRandomState is a xoshiro256** generator: four words of state, a
+* few shifts and adds per 64 random bits, and no lock, unlike rand().
+********************************************************************/
+typedef struct
+{ uint64_t s[4];
+} PokerRandomState;
+//Everything one caller works with, see poker_engine.c
+typedef struct PokerContext PokerContext;
+
+int  pokerInit(void);
+int  pokerInitSevenCards(void);
+int  pokerInitVariant(int variant, const PokerVariant **selected);
+void pokerInitOptions(PokerOptions *options);
+int  pokerCreateContext(const PokerOptions *options, PokerContext **context);
+void pokerDestroyContext(PokerContext *context);
+int  pokerEvaluateHands(PokerContext *context, const PokerHand hands[], int count,
+                        PokerResult results[]);
+int  pokerGenerateTable(PokerContext *context, const char *file);
+int  pokerGenerateTableShard(PokerContext *context, const char *file, int shard, int shardCount);
+int  pokerMergeTables(const char *file, const char *shards[], int shardCount, int *badShard);
+void pokerGetContextStats(const PokerContext *context, PokerStats *stats);
+const char *pokerErrorMessage(int error);
+const char *pokerKernelName(void);
+int  pokerVerifyHandTables(int *hands);
+int  pokerVerifySevenCardTables(int *hands);
+int  pokerVerifyVariants(int *hands);
+int  pokerVerifyTable(const char *file);
+
+//Building blocks, reentrant and free of context
+uint64_t pokerHandToMask(const PokerHand *hand);
+int  pokerRepeatCards(const PokerHand *hand);
+void pokerSortHand(PokerHand *hand);
+void pokerSortHandOrder(PokerHand *hand, uint8_t positions[]);
+void pokerSortHands(PokerHand hands[], int count);
+int  pokerGetHandRank(uint64_t mask);
+int  pokerIsBetterHand(uint64_t mask, int score);
+int  pokerEvaluateHand(uint64_t mask);
+int  pokerEvaluateSevenCards(uint64_t mask);
+int  pokerEvaluateSixCards(uint64_t mask);
+int  pokerGetBestHandRank(uint64_t mask);
+int  pokerHandCategory(int score);
+void pokerReferenceHandRank(uint64_t mask, int handID[]);
+int  pokerReferenceIsBetterHand(uint64_t mask, const int handID[]);
+void pokerSeedRandom(PokerRandomState *random, uint64_t seed);
+uint64_t pokerNextRandom(PokerRandomState *random);
+uint32_t pokerRandomBelow(PokerRandomState *random, uint32_t bound);
+#endif
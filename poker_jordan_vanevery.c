@@ -1,250 +1,826 @@
 /********************************************************************
 * Empirical Poker Hand Probability Generator
-* Jordan VanEvery ~ Last Modified: 2017-3-2 
+* Jordan VanEvery ~ Last Modified: 2017-3-2
 *
-* The program in its current state determines the probability of 
+* The program in its current state determines the probability of
 * improving a five card poker hand when allowed to discard a single
 * card from the hand and replace it with a remaining card in the deck
-* An empirical method is used, where a card it replaced at random 
-* many times, and upon each replacement it is determined if the 
+* An empirical method is used, where a card it replaced at random
+* many times, and upon each replacement it is determined if the
 * hand state improved.
-* 
-* The precision of the probabilities determined arbitrarily at this
-* point. No check for the convergence of the probability is made, 
-* rather a "sampleNumber" is preset that determines what number of
-* times a new card will be drawn. If time permits: the difference in
-* subsequent probabilities could be checked upon each replacement
-* until the change in a prob. is less than some desired precision.
 *
-* Example input/output: 2D 2C 5H 2H 2S 
-* --->2D 2C 5H 2H 2S >>>Four of a Kind 0.0% 0.0% 0.0% 0.0% 0.0%
+* With --monte-carlo the precision of the probabilities is set by a
+* preset "sampleNumber" that determines what number of times a new
+* card will be drawn. With --precision P each discard instead draws
+* blocks of cards until the 95% confidence interval of its estimate is
+* within P percentage points, with sampleNumber as the cap.
+* --histogram also gives, for every discard, the chance of ending on
+* each major rank and the mean score it ends on.
+* --equity K plays every hand against K random opponent hands instead
+* and gives its chance to win, to tie and its share of the pot.
+* --sampling picks how the cards are drawn and also prints the draws,
+* effective draws and variance of every estimate.
+*
+* Exact mode (the default, --exact) skips the sampling entirely and
+* walks every one of the cards remaining in the deck for each discard,
+* so the percentages are exact. The empirical path is kept behind
+* --monte-carlo for teaching and for validating the exact numbers.
+*
+* The probabilities are worked out by the engine in poker_engine.c,
+* this file reads the hands, hands them to one PokerContext and
+* writes the answers. With --listen it does the same for lines sent
+* over a socket, batching hands from all connections, see runServer.
+* With --binary it reads and writes fixed size records instead of text,
+* see runBinary. With --workers it spreads the lines over a pool of
+* contexts and still writes them back in order, see runPipeline.
+*
+* Example input/output: 2D 2C 5H 2H 2S
+* --->2D 2C 5H 2H 2S >>>Four of a Kind 0.0% 0.0% 76.6% 0.0% 0.0%
+*
+* Cards known to be out of the deck can follow the hand after a bar:
+* 2D 2C 5H 2H 2S | 9S KD
 ********************************************************************/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#define DECK_SIZE  52
-#define HAND_SIZE  5
-#define SUIT_COUNT 4
-#define RANK_COUNT 13
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "poker_engine.h"
+#define DECK_SIZE  POKER_DECK_SIZE
+#define HAND_SIZE  POKER_HAND_SIZE
+#define SUIT_COUNT POKER_SUIT_COUNT
+#define RANK_COUNT POKER_RANK_COUNT
 #define FALSE 0
 #define TRUE  1
-#define HIGH_CARD       1
-#define ONE_PAIR        2
-#define TWO_PAIR        3
-#define THREE_OF_A_KIND 4
-#define STRAIGHT        5
-#define FLUSH           6
-#define FULL_HOUSE      7
-#define FOUR_OF_A_KIND  8
-#define STRAIGHT_FLUSH  9
-#define DIGITS_IN_POKER_HAND_ID 3
-#define MAJOR_RANK_DIGIT 0
-#define MINOR_RANK_DIGIT 1
-#define LOW_PAIR_DIGIT   2
+//Modes of the program only, next to the engine's POKER_ modes
+#define VERIFY_MODE           2
+#define GENERATE_MODE         5
+#define MERGE_MODE            7
+#define INPUT_BUFFER_SIZE     (1<<20)
+#define OUTPUT_BUFFER_SIZE    (1<<20)
+#define CHAR_IS_SUIT          0x10
+#define CHAR_INVALID          0xFF
+#define PARSE_PHASE       0
+#define CLASSIFY_PHASE    1
+#define PROBABILITY_PHASE 2
+#define OUTPUT_PHASE      3
+#define PHASE_COUNT       4
+#define SEED_GIVEN            2
+//Longest answer is the draw line: 32 entries of " x.x.x 100.0% 7462.0"
+#define ANSWER_SIZE           1024
+#define DEFAULT_BATCH_SIZE    64
+#define MAX_BATCH_SIZE        1024
+#define DEFAULT_MAX_LATENCY   1000
+#define MAX_CLIENTS           256
+#define CLIENT_INPUT_SIZE     4096
+#define CLIENT_OUTPUT_LIMIT   (1<<20)
+#define REQUEST_ECHO_SIZE     256
+#define LISTEN_BACKLOG        64
+#define BINARY_MAGIC          "POKERBIN"
+#define BINARY_VERSION        1
+//Record formats of a binary header: two for input, two for output
+#define BINARY_CARDS          1
+#define BINARY_MASK           2
+#define BINARY_FLOAT          3
+#define BINARY_FIXED          4
+//Fixed point probabilities are in hundredths of a percent
+#define FIXED_POINT_SCALE     100
+//Lines per chunk of --workers, the text they may take and the chunks
+//in flight per worker
+#define CHUNK_LINES           32
+#define CHUNK_TEXT_SIZE       4096
+#define CHUNK_OUTPUT_SIZE     (CHUNK_TEXT_SIZE+CHUNK_LINES*(ANSWER_SIZE+5))
+#define CHUNKS_PER_WORKER     4
+#define MAX_CHUNK_SLOTS       (CHUNKS_PER_WORKER*POKER_MAX_THREADS)
+#define MAX(a,b) ((a)>(b) ? (a) : (b))
+#define MIN(a,b) ((a)<(b) ? (a) : (b))
 
 /*********************************************************************
 * Global constants
 *
 *   SUIT_LIST[]: Clubs, Diamonds, Hearts, Spades
 *   RANK_LIST[]: Cards ranks: 0->10, J->Jack, Q->Queen, K->king, A->Ace
+*   PHASE_NAMES[]/CATEGORY_NAMES[]: names --stats prints for the
+*     phases of a line and for the major ranks
 **********************************************************************/
 const char SUIT_LIST[] = "CDHS";
 const char  RANK_LIST[] = "234567890JQKA";
+const char *const PHASE_NAMES[PHASE_COUNT] =
+{ "parse", "classify", "probabilities", "output" };
+const char *const CATEGORY_NAMES[POKER_STRAIGHT_FLUSH+1] =
+{ "", "High Card", "Pair", "Two Pair", "Three of a Kind", "Straight", "Flush",
+  "Full House", "Four of a Kind", "Straight Flush" };
+/********************************************************************
+* Client is one connection of --listen.
+*   socket: the connection, -1 for a free slot
+*   input/inputLength: bytes read that do not make a whole line yet
+*   discarding: the line being read overflowed input, the rest of it
+*     is dropped up to its newline
+*   output/outputStart/outputLength/outputCapacity: replies not yet
+*     written run from outputStart to outputLength
+*   pending: lines of the connection in the batch being gathered
+*   closing: the peer has stopped sending, close once every reply
+*     is out
+*   broken: the connection failed, its replies are dropped
+********************************************************************/
+typedef struct
+{ int  socket;
+  char input[CLIENT_INPUT_SIZE];
+  size_t inputLength;
+  int  discarding;
+  char *output;
+  size_t outputStart, outputLength, outputCapacity;
+  int  pending;
+  int  closing;
+  int  broken;
+} Client;
+/********************************************************************
+* BinaryHeader starts both the input and the output of --binary, in
+* the byte order of the machine.
+*   magic/version: BINARY_MAGIC and BINARY_VERSION
+*   format: BINARY_CARDS or BINARY_MASK for input, BINARY_FLOAT or
+*     BINARY_FIXED for output
+*   mode: mode the output was worked out in, 0 in input
+*   recordSize: bytes of every record after the header
+********************************************************************/
+typedef struct
+{ char magic[8];
+  uint32_t version;
+  uint32_t format;
+  uint32_t mode;
+  uint32_t recordSize;
+} BinaryHeader;
+/********************************************************************
+* FloatRecord and FixedRecord are the output records of --binary, one
+* per input record in the same order.
+*   status: 1 for a good hand, 0 for a bad one with nothing else set
+*   category/score: major rank and score of the hand
+*   probabilities: per card in input order, in percent, or in
+*     hundredths of a percent for FixedRecord. A mask has its cards
+*     lowest bit first.
+********************************************************************/
+typedef struct
+{ uint8_t status;
+  uint8_t category;
+  uint16_t score;
+  float probabilities[HAND_SIZE];
+} FloatRecord;
+typedef struct
+{ uint8_t status;
+  uint8_t category;
+  uint16_t score;
+  uint16_t probabilities[HAND_SIZE];
+  uint16_t reserved;
+} FixedRecord;
+/********************************************************************
+* Chunk is one run of input lines going through --workers, in a slot
+* of the reorder buffer.
+*   lineCount: lines in the chunk
+*   lineStatus[]/hands[]: parseHand status and hand of every line,
+*     only the lines of status 1 go to the engine
+*   lineEnd[]/text[]: the lines one after the other, line i ending at
+*     lineEnd[i]
+*   output/outputLength: what the lines print, echo and answer, once
+*     a worker is done with the chunk
+*   done: set by the worker under pipelineLock
+********************************************************************/
+typedef struct
+{ int  lineCount;
+  int  lineStatus[CHUNK_LINES];
+  PokerHand hands[CHUNK_LINES];
+  uint16_t lineEnd[CHUNK_LINES];
+  char text[CHUNK_TEXT_SIZE];
+  char output[CHUNK_OUTPUT_SIZE];
+  size_t outputLength;
+  int  done;
+} Chunk;
+/********************************************************************
+* Worker is one evaluator thread of --workers with its own context.
+* Its queue holds the slots dealt to it, oldest at queueHead, under
+* its own lock. It takes the oldest of its own, and once those run
+* out steals the newest of another worker's, so one slow chunk never
+* keeps the other workers idle.
+*   results[]: what the engine works out for the chunk at hand
+********************************************************************/
+typedef struct
+{ pthread_t thread;
+  PokerContext *context;
+  pthread_mutex_t lock;
+  int  queue[MAX_CHUNK_SLOTS];
+  int  queueHead, queueCount;
+  PokerResult results[CHUNK_LINES];
+} Worker;
+/********************************************************************
+* Request is one line waiting in the batch
+*   client: slot of the connection it came from
+*   echo/echoLength: the line as its reply echoes it, cut at
+*     REQUEST_ECHO_SIZE bytes
+********************************************************************/
+typedef struct
+{ int  client;
+  char echo[REQUEST_ECHO_SIZE];
+  int  echoLength;
+} Request;
 /********************************************************************
 * External Variables
 *
-*   handRank[]: contains set of integers representing the rank of 
-*     each card in a HAND_SIZE size hand. This array is altered upon
-*     every iteration of the inner getProbabilities loop, and is 
-*     constantly re-sorted. 
-*   handSuit[]: contains a character suit corresponding to the suit
-*     of the card in a HAND_SIZE size hand.This array is altered upon
-*     every iteration of the inner getProbabilities loop, and is 
-*     constantly re-sorted. 
-*   pokerHandID[]: A 3 digit identification number
-*     Digit 1 ~ Major Rank ~ Pair, Full House, etc. ~ values 1-9
-*     Digit 2 ~ Minor Rank ~ Different for different Major Ranks,
-*               takes values of integer card ranks.
-*     Digit 3 ~ Two Pair Rank ~ 0 if not a Two pair, otherwise holds
-*               the card rank of the lower pair of the two.
-*     Example: 590 ~ Straight with high card 9
-*   copyHandrank[]: A copy of the original imput hand ranks before
-*     sorting or other manipulation.
-*   copyHandSuit[]: A copy of the original input hand suits befor
-*     sorting or other manipulation.
-********************************************************************/
-int  handRank[HAND_SIZE];
-char handSuit[HAND_SIZE];
-int  copyHandRank[HAND_SIZE];
-char copyHandSuit[HAND_SIZE];
-float probabilities[HAND_SIZE];
-int  pokerHandID[DIGITS_IN_POKER_HAND_ID];
+*   options: what the context is created with, filled in by
+*     parseArguments. Its mode can also be VERIFY_MODE, check the
+*     lookup tables instead of reading hands, GENERATE_MODE, write a
+*     table file, or MERGE_MODE, join shard files into one.
+*   hand: the hand of the last line, in input order, as read by
+*     readLine.
+*   result: what the engine worked out for hand.
+*   showStats: set by --stats, print a line of counters for every
+*     input line and totals at the end of the run.
+*   showVariance: set by --sampling, print the draws, effective draws
+*     and variance after every sampled estimate.
+*   statsLines/statsPhaseTime[]: lines read and nanoseconds spent
+*     in every phase of a line.
+*   statsCategoryLines[]/statsCategoryTime[]: good lines and time
+*     spent in getProbabilities by major rank of the hand.
+*   lastStats: counters of the context after the previous line, a
+*     line's counts are the difference.
+*   inputBuffer[]: block of standard input, the unread part runs
+*     from inputStart to inputEnd. inputAtEOF is set once read()
+*     has nothing more.
+*   outputBuffer[]: output waiting to be written in one block, the
+*     first outputLength bytes are used.
+*   cardCharTable[]: what every input character means as a card,
+*     see buildCharTables.
+*   listenAddress: socket --listen serves instead of standard input,
+*     listenPath is set when it is a Unix socket to remove at exit.
+*   batchSize/maxLatency: most hands in a batch and most microseconds
+*     the first of them waits, set by --batch-size and --max-latency.
+*   serverStopping: set by SIGINT or SIGTERM.
+*   clients[]/clientCount: connection slots and how many are used.
+*   batchRequests[]/batchHands[]/batchResults[]: the batch being
+*     gathered, batchCount lines since batchStart. batchStatus[] is
+*     the parse status of every line or record, 1 when it is a hand.
+*   statsBatches: batches evaluated, for --stats.
+*   shardIndex/shardCount: the shard --shard has --generate-table
+*     write, shardCount is 0 for the whole table.
+*   mergeFiles[]/mergeCount: the shard files --merge-table joins.
+*   binaryFormat: output format set by --binary, 0 for text.
+*   mappedInput/mappedLength/mappedOffset: standard input mapped
+*     into memory by runBinary when it is a file, read up to
+*     mappedOffset. NULL when it is read through inputBuffer.
+*   workerCount/workers: evaluator threads set by --workers, 0 to
+*     evaluate in main.
+*   chunks/chunkSlots: the reorder buffer of --workers, chunk n is
+*     in slot n%chunkSlots.
+*   pipelineLock/chunkQueued/chunkDone: queuedChunks counts chunks
+*     dealt but not yet taken, workers wait on chunkQueued for one
+*     and main on chunkDone for the oldest to finish.
+*   pipelineStopping: no more chunks come, set under pipelineLock.
+********************************************************************/
+PokerOptions options;
+PokerHand hand;
+PokerResult result;
+int  showStats;
+int  showVariance;
+uint64_t statsLines;
+uint64_t statsPhaseTime[PHASE_COUNT];
+uint64_t statsCategoryLines[POKER_STRAIGHT_FLUSH+1];
+uint64_t statsCategoryTime[POKER_STRAIGHT_FLUSH+1];
+PokerStats lastStats;
+char inputBuffer[INPUT_BUFFER_SIZE];
+size_t inputStart, inputEnd;
+int  inputAtEOF;
+char outputBuffer[OUTPUT_BUFFER_SIZE];
+size_t outputLength;
+uint8_t cardCharTable[256];
+const char *listenAddress;
+const char *listenPath;
+int  batchSize=DEFAULT_BATCH_SIZE;
+int  maxLatency=DEFAULT_MAX_LATENCY;
+volatile sig_atomic_t serverStopping;
+int  shardIndex, shardCount;
+const char **mergeFiles;
+int  mergeCount;
+int  binaryFormat;
+const uint8_t *mappedInput;
+size_t mappedLength, mappedOffset;
+int  workerCount;
+Worker *workers;
+Chunk *chunks;
+int  chunkSlots;
+pthread_mutex_t pipelineLock=PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t chunkQueued=PTHREAD_COND_INITIALIZER;
+pthread_cond_t chunkDone=PTHREAD_COND_INITIALIZER;
+int  queuedChunks;
+int  pipelineStopping;
+Client clients[MAX_CLIENTS];
+int  clientCount;
+Request batchRequests[MAX_BATCH_SIZE];
+PokerHand batchHands[MAX_BATCH_SIZE];
+PokerResult batchResults[MAX_BATCH_SIZE];
+int  batchStatus[MAX_BATCH_SIZE];
+int  batchCount;
+uint64_t batchStart;
+uint64_t statsBatches;
 
+int  parseArguments(int argc, char *argv[]);
+void printError(int error);
 int  readLine(void);
-int  isSuit(char c);
-int  isRank(char c);
-void loadCopyHand(void);
+int  findLine(char **line, size_t *length);
+int  parseHand(const char *line, size_t length, PokerHand *parsed);
+int  parseCards(const char *line, size_t length, uint8_t cards[], int maxCards);
+void buildCharTables(void);
+void fillInput(void);
+void writeOutput(const char *data, size_t length);
+void writeString(const char *text);
+void flushOutput(void);
+void writeAll(const char *data, size_t length);
 int  rankToInt(char rank);
-char trashToEndOfLine(void);
-int  repeatCards(void);
-void sortHand();
-void printHandRank(void);
-void getProbabilities(void);
-void printProbabilities(void);
-int  isFlush(void);
-int  isStraight(void);
-int  isXOfAKind(int);
-int  isFullHouse(void);
-int  isTwoPair(void);
-int  highCard(void);
-void getHandRank(void);
-int  isBetterHand(void);
+int  suitToInt(char suit);
+void evaluateParsed(PokerContext *context, PokerHand hands[], const int lineStatus[], int count,
+                    PokerResult results[]);
+size_t formatAnswer(char text[], int lineStatus, const PokerResult *answered);
+uint64_t statsClock(void);
+void recordLineStats(const PokerContext *context, int lineStatus, const uint64_t marks[]);
+void printStats(const PokerContext *context);
 void printHand(void);
+int  runServer(PokerContext *context);
+void stopServer(int signal);
+int  openListener(const char *address);
+void acceptClients(int listener);
+void readClient(PokerContext *context, int slot);
+void queueRequest(PokerContext *context, int slot, const char *line, size_t length,
+                  int overflow);
+void flushBatch(PokerContext *context);
+void queueReply(Client *client, const char *data, size_t length);
+void writeClient(int slot);
+void reapClients(void);
+uint64_t serverClock(void);
+int  runBinary(PokerContext *context);
+void mapInput(void);
+size_t nextBinaryBlock(const uint8_t **block, size_t recordSize, size_t limit);
+int  decodeRecord(const uint8_t *record, int format, PokerHand *decoded);
+void writeRecord(int recordStatus, const PokerResult *answered);
+int  runPipeline(PokerContext *context);
+int  startWorkers(PokerContext *context);
+void stopWorkers(void);
+void dealChunk(uint64_t sequence);
+void drainChunks(uint64_t *oldest, uint64_t filled);
+void *pipelineWorker(void *arg);
+int  takeChunk(int self);
+void answerChunk(Worker *worker, Chunk *chunk);
 
 
-int main(void)
-{ int lineStatus,i;
-  //Seed rand number generator for later    
-  srand((unsigned long)time(NULL));
-  // Check for input error, echo input
-  while((lineStatus=readLine())!=EOF)
-  { //copy original input hand for reference to ordering
-    for(i=0; i<HAND_SIZE; ++i)
-    { copyHandRank[i]=handRank[i];
-      copyHandSuit[i]=handSuit[i];
-    }
-    printf(" >>>");
-    //Got a good line 
-    if(lineStatus==1)
-    { sortHand();
-      getHandRank();
-      getProbabilities();
-      printHandRank();
-      //print probabilities
-      for(int i=0; i<HAND_SIZE; ++i)
-      { printf(" %.1f%%",probabilities[i]);
-      }
+int main(int argc, char *argv[])
+{ char answer[ANSWER_SIZE];
+  uint64_t marks[PHASE_COUNT+1];
+  PokerContext *context;
+  int lineStatus, seedGiven, error, generate, hands, mismatches, badShard;
+  pokerInitOptions(&options);
+  if((seedGiven=parseArguments(argc, argv))==FALSE)
+  { fprintf(stderr,"Usage: %s [--exact | --monte-carlo | --verify] [--threads N] [--seed N]\n"
+                   "       [--samples N] [--precision P] [--sampling random|stratified|sobol]\n"
+                   "       [--cache-size MB] [--stats] [--histogram]\n"
+                   "       [--table FILE | --generate-table FILE [--shard I/N]] [--draw | --holdem | --equity K]\n"
+                   "       [--merge-table FILE SHARD...]\n"
+                   "       [--listen ADDRESS [--batch-size N] [--max-latency US]]\n"
+                   "       [--binary float|fixed] [--workers N]\n",argv[0]);
+    return 1;
+  }
+  if(options.mode==MERGE_MODE)
+  { if((error=pokerMergeTables(options.tableFile,mergeFiles,mergeCount,&badShard))!=POKER_OK)
+    { fprintf(stderr,"%s: %s\n",(badShard>=0) ? mergeFiles[badShard] : options.tableFile,
+              pokerErrorMessage(error));
+    }
+    return (error==POKER_OK) ? 0 : 1;
+  }
+  //--verify --table checks the whole table file and nothing else
+  if(options.mode==VERIFY_MODE && options.tableFile!=NULL)
+  { if((error=pokerVerifyTable(options.tableFile))!=POKER_OK) printError(error);
+    else printf("%s: table checked, counts and checksum match\n",options.tableFile);
+    return (error==POKER_OK) ? 0 : 1;
+  }
+  if((error=pokerInit())!=POKER_OK)
+  { printError(error);
+    return 1;
+  }
+  if(options.mode==VERIFY_MODE)
+  { mismatches=pokerVerifyHandTables(&hands);
+    printf("%d hands checked, %d mismatches\n",hands,mismatches);
+    if((error=pokerInitSevenCards())!=POKER_OK)
+    { printError(error);
+      return 1;
     }
-    //Bad line
-    else
-    { printf("Error");
+    error=pokerVerifySevenCardTables(&hands);
+    printf("%d seven card hands checked, %d mismatches\n",hands,error);
+    mismatches+=error;
+    if((error=pokerVerifyVariants(&hands))<0)
+    { printError(POKER_TABLES_FAILED);
+      return 1;
     }
-    printf("\n");
+    printf("%d six card and short deck hands checked, %d mismatches\n",hands,error);
+    return (mismatches==0 && error==0) ? 0 : 1;
+  }
+  buildCharTables();
+  //Seed rand number generator for later
+  if(seedGiven==FALSE) options.seed=(uint64_t)time(NULL);
+  //A table holds exact counts, the context works them out
+  if((generate=(options.mode==GENERATE_MODE))==TRUE) options.mode=POKER_EXACT_MODE;
+  //Every worker has a cache of its own, they share the cap
+  if(workerCount>0 && options.cacheMegabytes>0)
+  { options.cacheMegabytes=MAX(1,options.cacheMegabytes/workerCount);
+  }
+  if((error=pokerCreateContext(&options,&context))!=POKER_OK)
+  { printError(error);
+    return 1;
+  }
+  if(generate==TRUE)
+  { error=(shardCount>0) ? pokerGenerateTableShard(context,options.tableFile,shardIndex,shardCount)
+                         : pokerGenerateTable(context,options.tableFile);
+    if(error!=POKER_OK) printError(error);
+    if(showStats==TRUE) printStats(context);
+    pokerDestroyContext(context);
+    return (error==POKER_OK) ? 0 : 1;
   }
+  if(listenAddress!=NULL)
+  { error=runServer(context);
+    pokerDestroyContext(context);
+    return error;
+  }
+  if(binaryFormat!=0)
+  { error=runBinary(context);
+    if(showStats==TRUE) printStats(context);
+    pokerDestroyContext(context);
+    return error;
+  }
+  if(workerCount>0)
+  { error=runPipeline(context);
+    pokerDestroyContext(context);
+    return error;
+  }
+  // Check for input error, echo input
+  for(;;)
+  { marks[PARSE_PHASE]=statsClock();
+    if((lineStatus=readLine())==EOF) break;
+    writeString(" >>>");
+    marks[CLASSIFY_PHASE]=statsClock();
+    //hand stays in input order for placing probabilities
+    if(lineStatus==1) result.score=pokerGetBestHandRank(pokerHandToMask(&hand));
+    marks[PROBABILITY_PHASE]=statsClock();
+    if(lineStatus==1) pokerEvaluateHands(context,&hand,1,&result);
+    marks[OUTPUT_PHASE]=statsClock();
+    writeOutput(answer,formatAnswer(answer,lineStatus,&result));
+    writeString("\n");
+    marks[PHASE_COUNT]=statsClock();
+    if(showStats==TRUE) recordLineStats(context,lineStatus,marks);
+  }
+  flushOutput();
+  if(showStats==TRUE) printStats(context);
+  pokerDestroyContext(context);
   return 0;
 }
+/********************************************************************
+* Reads the command line options into options and the globals.
+*   --exact        enumerate every remaining card (default)
+*   --monte-carlo  draw sampleNumber random cards per discard
+*   --precision P  sample each discard until its 95% confidence
+*                  interval is within P percentage points
+*   --samples N    sampleNumber, the draws per discard of
+*                  --monte-carlo and the cap of --precision
+*   --sampling M   draw the samples at random, stratified by card or
+*                  along a Sobol sequence, and show their variance
+*   --verify       check the lookup tables against the reference
+*                  classifier on every hand, the seven card tables
+*                  against the five card ones and every variant
+*                  evaluator, then exit. With --table FILE check
+*                  every count and the checksum of FILE instead
+*   --holdem       read two hole cards and a flop, turn or river,
+*                  and give the chance of improving by the river
+*   --histogram    follow every probability with the percentage of
+*                  ending on each major rank and the mean score
+*   --equity K     deal sampleNumber sets of K random opponent
+*                  hands and give the win, tie and pot share of the
+*                  hand against them
+*   --threads N    run the Monte Carlo samples on N threads
+*   --seed N       seed the Monte Carlo generators with N, so runs
+*                  can be repeated
+*   --listen ADDRESS     serve hands on a Unix socket path or a
+*                        [HOST:]PORT instead of standard input
+*   --batch-size N       evaluate at most N hands per batch
+*   --max-latency US     evaluate a batch once its first hand has
+*                        waited US microseconds
+*   --shard I/N          have --generate-table write only shard I of
+*                        N, counting from 0
+*   --merge-table FILE SHARD...  join all shards of a table into
+*                        FILE, every argument after FILE is a shard
+*   --binary F     read binary hand records and write binary result
+*                  records, float or fixed point. Only the modes with
+*                  one probability per card can, and not with
+*                  --histogram or --listen.
+*   --workers N    evaluate chunks of lines on N threads with a
+*                  context each, writing them back in input order.
+*                  Not with --stats, --listen or --binary.
+*
+* Returns FALSE if an option was not understood, otherwise TRUE, or
+* SEED_GIVEN when --seed set the seed
+********************************************************************/
+int parseArguments(int argc, char *argv[])
+{ int i, result=TRUE;
+  for(i=1; i<argc; ++i)
+  { if(strcmp(argv[i],"--exact")==0) options.mode=POKER_EXACT_MODE;
+    else if(strcmp(argv[i],"--monte-carlo")==0) options.mode=POKER_MONTE_CARLO_MODE;
+    else if(strcmp(argv[i],"--verify")==0) options.mode=VERIFY_MODE;
+    else if(strcmp(argv[i],"--precision")==0 && i+1<argc)
+    { options.mode=POKER_ADAPTIVE_MODE;
+      options.precision=atof(argv[++i]);
+      if(options.precision<=0) return FALSE;
+    }
+    else if(strcmp(argv[i],"--sampling")==0 && i+1<argc)
+    { ++i;
+      if(strcmp(argv[i],"random")==0) options.sampling=POKER_RANDOM_SAMPLING;
+      else if(strcmp(argv[i],"stratified")==0) options.sampling=POKER_STRATIFIED_SAMPLING;
+      else if(strcmp(argv[i],"sobol")==0) options.sampling=POKER_SOBOL_SAMPLING;
+      else return FALSE;
+      showVariance=TRUE;
+    }
+    else if(strcmp(argv[i],"--samples")==0 && i+1<argc)
+    { options.sampleNumber=atoi(argv[++i]);
+      if(options.sampleNumber<1) return FALSE;
+    }
+    else if(strcmp(argv[i],"--threads")==0 && i+1<argc)
+    { options.threadCount=atoi(argv[++i]);
+      if(options.threadCount<1 || options.threadCount>POKER_MAX_THREADS) return FALSE;
+    }
+    else if(strcmp(argv[i],"--seed")==0 && i+1<argc)
+    { options.seed=strtoull(argv[++i],NULL,0);
+      result=SEED_GIVEN;
+    }
+    else if(strcmp(argv[i],"--cache-size")==0 && i+1<argc)
+    { options.cacheMegabytes=atoi(argv[++i]);
+      if(options.cacheMegabytes<0) return FALSE;
+    }
+    else if(strcmp(argv[i],"--stats")==0) showStats=TRUE;
+    else if(strcmp(argv[i],"--histogram")==0) options.histogram=TRUE;
+    else if(strcmp(argv[i],"--draw")==0) options.mode=POKER_DRAW_MODE;
+    else if(strcmp(argv[i],"--holdem")==0) options.mode=POKER_HOLDEM_MODE;
+    else if(strcmp(argv[i],"--equity")==0 && i+1<argc)
+    { options.mode=POKER_EQUITY_MODE;
+      options.opponents=atoi(argv[++i]);
+      if(options.opponents<1 || options.opponents>POKER_MAX_OPPONENTS) return FALSE;
+    }
+    else if(strcmp(argv[i],"--table")==0 && i+1<argc)
+    { if(options.mode!=VERIFY_MODE) options.mode=POKER_TABLE_MODE;
+      options.tableFile=argv[++i];
+    }
+    else if(strcmp(argv[i],"--listen")==0 && i+1<argc) listenAddress=argv[++i];
+    else if(strcmp(argv[i],"--batch-size")==0 && i+1<argc)
+    { batchSize=atoi(argv[++i]);
+      if(batchSize<1 || batchSize>MAX_BATCH_SIZE) return FALSE;
+    }
+    else if(strcmp(argv[i],"--max-latency")==0 && i+1<argc)
+    { maxLatency=atoi(argv[++i]);
+      if(maxLatency<0) return FALSE;
+    }
+    else if(strcmp(argv[i],"--generate-table")==0 && i+1<argc)
+    { options.mode=GENERATE_MODE;
+      options.tableFile=argv[++i];
+    }
+    else if(strcmp(argv[i],"--shard")==0 && i+1<argc)
+    { if(sscanf(argv[++i],"%d/%d",&shardIndex,&shardCount)!=2
+         || shardCount<1 || shardIndex<0 || shardIndex>=shardCount) return FALSE;
+    }
+    else if(strcmp(argv[i],"--merge-table")==0 && i+2<argc)
+    { options.mode=MERGE_MODE;
+      options.tableFile=argv[++i];
+      mergeFiles=(const char **)&argv[i+1];
+      mergeCount=argc-i-1;
+      break;
+    }
+    else if(strcmp(argv[i],"--binary")==0 && i+1<argc)
+    { ++i;
+      if(strcmp(argv[i],"float")==0) binaryFormat=BINARY_FLOAT;
+      else if(strcmp(argv[i],"fixed")==0) binaryFormat=BINARY_FIXED;
+      else return FALSE;
+    }
+    else if(strcmp(argv[i],"--workers")==0 && i+1<argc)
+    { workerCount=atoi(argv[++i]);
+      if(workerCount<1 || workerCount>POKER_MAX_THREADS) return FALSE;
+    }
+    else return FALSE;
+  }
+  if(workerCount>0 && (showStats==TRUE || listenAddress!=NULL || binaryFormat!=0))
+  { return FALSE;
+  }
+  if(binaryFormat!=0 && (options.histogram==TRUE || listenAddress!=NULL
+                         || (options.mode!=POKER_EXACT_MODE
+                             && options.mode!=POKER_MONTE_CARLO_MODE
+                             && options.mode!=POKER_ADAPTIVE_MODE
+                             && options.mode!=POKER_TABLE_MODE)))
+  { return FALSE;
+  }
+  return result;
+}
+/********************************************************************
+* printError reports an engine error on standard error, with the
+* table file in front when the error is about it
+********************************************************************/
+void printError(int error)
+{ if((error>=POKER_TABLE_UNREADABLE && error<=POKER_TABLE_UNWRITABLE)
+     || error==POKER_CHECKSUM_MISMATCH)
+  { fprintf(stderr,"%s: %s\n",options.tableFile,pokerErrorMessage(error));
+  }
+  else fprintf(stderr,"%s\n",pokerErrorMessage(error));
+}
 /****************************************************
- * Reads a line from standard input.
+ * Reads a line from standard input through the input
+ * buffer and echoes it to the output buffer. A last
+ * line without a newline is still read. A line that
+ * does not fit in the buffer is echoed in pieces and
+ * is always an error.
  * Returns
  *   1 if no errors
  *   0 if error
- *   EOF if last line is read
- * Vars
- *   isError: error flag, also can possibly hold EOF
- *   ____Count: counters for various detections
- *
+ *   EOF if there are no more lines
  ****************************************************/
 int readLine(void)
-{
-char c;
-int isError=1,charCount=0,inputCount=0,rankCount=0,suitCount=0, branchNum=0;
-  while((c=getchar())!='\n' && c!=EOF)
-  { printf("%c",c);
-    charCount+=1;
-    branchNum+=1;
-    if(branchNum>3) branchNum=1;
-    //rank card should be here
-    if(branchNum==1)
-    { 
-      if(isRank(c)==TRUE)
-      { handRank[rankCount]=rankToInt(c);
-        rankCount+=1;
-      }
-      else
-      { isError=0;
-        c=trashToEndOfLine();
-      }
-    }
-    //suit card should be here
-    else if(branchNum==2)
-    { 
-      if(isSuit(c)==TRUE)
-      { handSuit[suitCount]=c;
-        suitCount+=1;
-	inputCount+=1;
-      }
-      else
-      { isError=0;
-        c=trashToEndOfLine();
-      }
-    }
-    //space should be here
-    else if(branchNum==3)
-    {
-      if(c==' ')
-      {
-      }
-      else
-      { isError=0;
-        c=trashToEndOfLine();
-      }
-    }
-    if((c=='\n'||c==EOF))
-    { break;
-    }
+{ char *line;
+  size_t length;
+  int found, overflow=FALSE;
+  while((found=findLine(&line,&length))==FALSE)
+  { writeOutput(inputBuffer,inputEnd);
+    inputStart=inputEnd;
+    overflow=TRUE;
   }
-  //Some last checks that make a hand invalid
-  if(inputCount!=HAND_SIZE) isError=0;
-  if(repeatCards()==TRUE) isError=0;
-  if(c==EOF) isError=EOF;
-
-  return isError; 
+  if(found==EOF) return (overflow==TRUE) ? 0 : EOF;
+  writeOutput(line,length);
+  if(overflow==TRUE) return 0;
+  return parseHand(line,length,&hand);
 }
 /********************************************************************
-* isSuit determines if one of the input suits is a valid suit
-* 
-* Returns an integer TRUE or FALSE
-* Takes a character as a parameter
+* findLine takes the next line out of the input buffer, reading more
+* of standard input until it holds a whole line. The line stays good
+* until the buffer is filled again.
+*
+* Returns TRUE with the line and its length, EOF once there are no
+* more lines, or FALSE with nothing taken when the buffer is full
+* without a newline
+********************************************************************/
+int findLine(char **line, size_t *length)
+{ char *newline;
+  while((newline=memchr(inputBuffer+inputStart,'\n',inputEnd-inputStart))==NULL
+        && inputAtEOF==FALSE)
+  { if(inputStart==0 && inputEnd==INPUT_BUFFER_SIZE) return FALSE;
+    fillInput();
+  }
+  *line=inputBuffer+inputStart;
+  *length=(newline!=NULL) ? (size_t)(newline-*line) : inputEnd-inputStart;
+  if(newline==NULL && *length==0) return EOF;
+  inputStart+=*length+(newline!=NULL);
+  return TRUE;
+}
+/********************************************************************
+* parseHand reads HAND_SIZE cards of the form "RS RS RS RS RS" into
+* parsed, or with --holdem POKER_HOLDEM_MIN_CARDS to
+* POKER_MAX_HAND_CARDS cards.
+* A single trailing space is allowed. The hand may be followed by " | "
+* and a list of dead cards in the same form, known to be out of the
+* deck, which go into deadMask. Each character is checked with one
+* load from cardCharTable.
+*
+* Returns 1 for a valid hand without repeated cards, 0 otherwise
+* Takes the line and its length, it need not be NUL terminated, and
+* the hand to fill
 ********************************************************************/
-int isSuit(char inputSuit)
-{ int i, isValidSuit=FALSE;
+int parseHand(const char *line, size_t length, PokerHand *parsed)
+{ const char *bar=memchr(line,'|',length);
+  uint8_t dead[DECK_SIZE];
+  size_t handLength=(bar!=NULL) ? (size_t)(bar-line) : length;
+  int i, cards, deadCount;
+  parsed->cardCount=0;
+  parsed->deadMask=0;
+  if(bar!=NULL)
+  { if(handLength==0 || line[handLength-1]!=' ' || handLength+2>length || bar[1]!=' ') return 0;
+    deadCount=parseCards(bar+2,length-handLength-2,dead,DECK_SIZE);
+    if(deadCount<1) return 0;
+    for(i=0; i<deadCount; ++i) parsed->deadMask|=(uint64_t)1<<dead[i];
+    if(__builtin_popcountll(parsed->deadMask)!=deadCount) return 0;
+  }
+  cards=parseCards(line,handLength,parsed->cards,POKER_MAX_HAND_CARDS);
+  if(cards!=HAND_SIZE && (options.mode!=POKER_HOLDEM_MODE
+                          || cards<POKER_HOLDEM_MIN_CARDS || cards>POKER_MAX_HAND_CARDS)) return 0;
+  parsed->cardCount=cards;
+  if(pokerRepeatCards(parsed)==TRUE || (pokerHandToMask(parsed) & parsed->deadMask)!=0) return 0;
+  return 1;
+}
+/********************************************************************
+* parseCards reads a list of cards of the form "RS RS ...", allowing
+* a single trailing space, into cards[].
+*
+* Returns the number of cards, or -1 for a malformed list or one of
+* more than maxCards cards
+* Takes the text and its length and where the cards go
+********************************************************************/
+int parseCards(const char *line, size_t length, uint8_t cards[], int maxCards)
+{ int i, rank, suit, count=(int)((length+1)/3);
+  if(count>maxCards) return -1;
+  if(length!=3*(size_t)count-1 && (length!=3*(size_t)count || line[length-1]!=' ')) return -1;
+  for(i=0; i<count; ++i)
+  { rank=cardCharTable[(unsigned char)line[3*i]];
+    suit=cardCharTable[(unsigned char)line[3*i+1]];
+    if(rank>=RANK_COUNT || (suit & ~(SUIT_COUNT-1))!=CHAR_IS_SUIT) return -1;
+    if(i<count-1 && line[3*i+2]!=' ') return -1;
+    cards[i]=POKER_CARD(rank,suit & (SUIT_COUNT-1));
+  }
+  return count;
+}
+/********************************************************************
+* buildCharTables fills cardCharTable: the rank index of every rank
+* character of RANK_LIST, CHAR_IS_SUIT plus the suit index of every
+* suit character of SUIT_LIST, and CHAR_INVALID everywhere else.
+*
+* No returns no parameters
+********************************************************************/
+void buildCharTables(void)
+{ int i;
+  memset(cardCharTable,CHAR_INVALID,sizeof(cardCharTable));
+  for(i=0; i<RANK_COUNT; ++i) cardCharTable[(unsigned char)RANK_LIST[i]]=i;
   for(i=0; i<SUIT_COUNT; ++i)
-  { if(inputSuit==SUIT_LIST[i])
-    { isValidSuit=TRUE;
-      break;
-    }
+  { cardCharTable[(unsigned char)SUIT_LIST[i]]=CHAR_IS_SUIT|i;
   }
-  return isValidSuit;
 }
 /********************************************************************
-* isRank determines if the char handed to it is a valid rank
-* for a card in a typical 52 card deck
-* 
-* Returns an int TRUE=1 or FALSE=0
-* Takes a character that represents a rank
-********************************************************************/
-int isRank(char inputRank)
-{ int i, isValidRank=FALSE;
-  for(i=0; i<RANK_COUNT; ++i)
-  { if(inputRank==RANK_LIST[i])
-    { isValidRank=TRUE;
-      break;
+* fillInput reads more of standard input behind what is left in the
+* input buffer, after moving the unread part to the front. Pending
+* output is written first, so an interactive user sees every answer
+* before the program waits for the next line.
+*
+* No returns no parameters, sets inputAtEOF at end of input
+********************************************************************/
+void fillInput(void)
+{ ssize_t count;
+  flushOutput();
+  memmove(inputBuffer,inputBuffer+inputStart,inputEnd-inputStart);
+  inputEnd-=inputStart;
+  inputStart=0;
+  do
+  { count=read(STDIN_FILENO,inputBuffer+inputEnd,INPUT_BUFFER_SIZE-inputEnd);
+  }while(count<0 && errno==EINTR);
+  if(count<=0) inputAtEOF=TRUE;
+  else inputEnd+=count;
+}
+/********************************************************************
+* writeOutput appends to the output buffer, writing the buffer out
+* as one block whenever the new data would not fit.
+*
+* Takes the data and its length
+********************************************************************/
+void writeOutput(const char *data, size_t length)
+{ if(outputLength+length>OUTPUT_BUFFER_SIZE)
+  { flushOutput();
+    if(length>OUTPUT_BUFFER_SIZE)
+    { writeAll(data,length);
+      return;
     }
   }
-  return isValidRank;
+  memcpy(outputBuffer+outputLength,data,length);
+  outputLength+=length;
 }
-/***********************************************************************
-* Reads rest of line into temp character to avoid storing massive input
-* Prints trashed characters. 
-*
-* Returns either a newline or EOF character
-* no paramters
-***********************************************************************/
-char trashToEndOfLine(void)
-{
-  char c;
-  while((c=getchar())!='\n' && c!=EOF)
-  { printf("%c",c);
+/********************************************************************
+* writeString appends a NUL terminated string to the output buffer
+********************************************************************/
+void writeString(const char *text)
+{ writeOutput(text,strlen(text));
+}
+/********************************************************************
+* flushOutput writes the whole output buffer to standard output
+********************************************************************/
+void flushOutput(void)
+{ writeAll(outputBuffer,outputLength);
+  outputLength=0;
+}
+/********************************************************************
+* writeAll writes a block to standard output, retrying partial and
+* interrupted writes. Gives up quietly if the output is gone.
+********************************************************************/
+void writeAll(const char *data, size_t length)
+{ ssize_t count;
+  while(length>0)
+  { count=write(STDOUT_FILENO,data,length);
+    if(count<0 && errno==EINTR) continue;
+    if(count<=0) return;
+    data+=count;
+    length-=count;
   }
 }
 /********************************************************************
@@ -261,563 +837,936 @@ char trashToEndOfLine(void)
 * the ace as a 1 for practical reasons)
 ********************************************************************/
 int rankToInt(char c)
-{ int rankAsInteger;
-  if(c>='2' && c<='9')
-  { rankAsInteger = c - '0';
+{ return cardCharTable[(unsigned char)c]+2;
+}
+/********************************************************************
+* Maps a suit character to its index in SUIT_LIST, which is also the
+* index of the suit's 13 bit field in a card mask
+*
+* Returns the suit index 0-3, takes a valid suit character
+********************************************************************/
+int suitToInt(char c)
+{ return cardCharTable[(unsigned char)c] & (SUIT_COUNT-1);
+}
+/********************************************************************
+* evaluateParsed runs one pokerEvaluateHands call on the hands of a
+* batch that parsed. They are moved to the front of hands[] first, so a
+* line or record that is not a hand never reaches the engine, and their
+* results are moved back to the place of their line afterwards. The
+* reply of a line has to check lineStatus[] before its result, which
+* is left as it was for a line that did not parse.
+*
+* No returns, takes the hands, the parse status of every one, 1 for
+* a hand, their number and the results to fill
+********************************************************************/
+void evaluateParsed(PokerContext *context, PokerHand hands[], const int lineStatus[], int count,
+                    PokerResult results[])
+{ int i, parsed=0;
+  for(i=0; i<count; ++i)
+  { if(lineStatus[i]==1) hands[parsed++]=hands[i];
   }
-  else
-  { int i;
-    //8 is the index where the 10 rank is held
-    for(i=8; i<RANK_COUNT; ++i)
-    { if(c==RANK_LIST[i])
-      { rankAsInteger = i+2;
-        break;
-      } 
-    }
+  if(parsed>0) pokerEvaluateHands(context,hands,parsed,results);
+  //From the back, a result only ever moves to a later place
+  for(i=count-1; i>=0 && parsed>0; --i)
+  { if(lineStatus[i]==1 && i!=--parsed) results[i]=results[parsed];
   }
-  return (int)rankAsInteger;
 }
 /********************************************************************
-* loadCopyHand copies the elements of copyHandRank and copyHandSuit
-* into handRank and handSuit respectively
+* formatAnswer writes what comes after " >>>" for one line: the rank
+* of the hand and its probabilities, or Error for a bad line. In
+* POKER_DRAW_MODE there is one entry per subset of input cards
+* instead: a pattern with x for a discarded card and . for a kept one,
+* the improvement percentage and the expected score. In
+* POKER_HOLDEM_MODE the rank of the best five cards has the one
+* percentage of improving by the river after it, in POKER_EQUITY_MODE
+* the win, tie and pot share percentages against the opponents. With
+* --sampling every sampled probability is followed by its draws,
+* effective draws and variance. With --histogram
+* every probability is followed by the percentages of ending on each
+* major rank, from High Card up, and the mean score in brackets.
 *
-* No returns, no paramters
+* Returns the length written to text[], which holds ANSWER_SIZE bytes
+* Takes the readLine status of the line and its result
 ********************************************************************/
-void loadCopyHand(void)
-{ int i;
-  for(i=0; i<HAND_SIZE; ++i)
-  { handRank[i]=copyHandRank[i];
-    handSuit[i]=copyHandSuit[i];
-  }
-}
-/********************************************************************
-* Prints the rank of the hand encoded in pokerHandID. Looks at the
-* major rank digit to make a decision in the switch.
-*
-* No returns no paramters
-*********************************************************************/
-void printHandRank(void)
-{ int handRankAsInt;
-    switch(pokerHandID[MAJOR_RANK_DIGIT])
-    { case HIGH_CARD:
-        printf("High Card");
-        break;
-      case ONE_PAIR:
-        printf("Pair");
-        break;
-      case TWO_PAIR:
-        printf("Two Pair");
-        break;
-      case THREE_OF_A_KIND:
-        printf("Three of a Kind"); 
-        break;
-      case STRAIGHT:
-        printf("Straight");
-        break;
-      case FLUSH:
-        printf("Flush");
-        break;
-      case FULL_HOUSE: 
-        printf("Full House");
-        break;
-      case FOUR_OF_A_KIND:
-        printf("Four of a Kind");
-        break;
-      case STRAIGHT_FLUSH:
-        printf("Straight Flush");
-        break; 
-    }
-}
-/********************************************************************
-* Determines whether or not a repeat card is in handRank and handSuit
-* 
-* Returns TRUE if hand has repeated cards
-*         FALSE if not
-*************************************/
-int repeatCards(void)
-{ char rank, suit;
-  int i, j,repCard=FALSE;
-  for(i=0;i<HAND_SIZE;++i)
-  { rank = handRank[i];
-    suit = handSuit[i];
-    for(j=i+1;j<HAND_SIZE;++j)
-    { 
-      if(rank==handRank[j] && suit==handSuit[j]) repCard=TRUE;
-    }
-  }
-  return repCard;
+size_t formatAnswer(char text[], int lineStatus, const PokerResult *answered)
+{ size_t length;
+  int subset, i, category;
+  //Bad line
+  if(lineStatus!=1 || answered->status==FALSE)
+  { strcpy(text,"Error");
+    return strlen(text);
+  }
+  length=strlen(strcpy(text,CATEGORY_NAMES[answered->category]));
+  if(options.mode==POKER_HOLDEM_MODE)
+  { return length+snprintf(text+length,ANSWER_SIZE-length," %.1f%%",answered->riverImprovement);
+  }
+  if(options.mode==POKER_EQUITY_MODE)
+  { return length+snprintf(text+length,ANSWER_SIZE-length," win %.1f%% tie %.1f%% equity %.1f%%",
+                           answered->winProbability,answered->tieProbability,answered->equity);
+  }
+  if(options.mode!=POKER_DRAW_MODE)
+  { for(i=0; i<HAND_SIZE; ++i)
+    { length+=snprintf(text+length,ANSWER_SIZE-length," %.1f%%",answered->probabilities[i]);
+      if(showVariance==TRUE && (options.mode==POKER_MONTE_CARLO_MODE
+                                || options.mode==POKER_ADAPTIVE_MODE))
+      { length+=snprintf(text+length,ANSWER_SIZE-length," (n %d, eff %.0f, var %.3g)",
+                         answered->samplesDrawn[i],answered->effectiveSamples[i],
+                         answered->variances[i]);
+      }
+      if(options.histogram==TRUE)
+      { text[length++]=' ';
+        text[length++]='[';
+        for(category=0; category<POKER_CATEGORY_COUNT; ++category)
+        { length+=snprintf(text+length,ANSWER_SIZE-length,"%.1f ",
+                           answered->categoryProbabilities[i][category]);
+        }
+        length+=snprintf(text+length,ANSWER_SIZE-length,"E %.1f]",answered->expectedScores[i]);
+      }
+    }
+    return length;
+  }
+  for(subset=0; subset<POKER_SUBSET_COUNT; ++subset)
+  { text[length++]=' ';
+    for(i=0; i<HAND_SIZE; ++i) text[length++]=(subset & (1<<i)) ? 'x' : '.';
+    length+=snprintf(text+length,ANSWER_SIZE-length," %.1f%% %.1f",
+                     answered->drawImprovement[subset],answered->drawExpectedScore[subset]);
+  }
+  return length;
 }
 /************************************************************************
-* Calculates a series probabilities for the likelihood of improving the
-* rank of your hand by discarding a certain card. These values are stored
-* in a global array and is a parallel array with handRank and handSuit.
+* statsClock reads the monotonic clock for the --stats timers. Without
+* --stats it returns 0 straight away, so the timers in main cost
+* nothing when nobody asked for them.
 *
-* No returns no parameters, resulting probabilities are stored into a 
-* global variable.
+* Returns nanoseconds from an arbitrary start
 **************************************************************************/
-void getProbabilities(void)
-{ char tempSuit, randSuit;
-  int sampleNumber=750000, numOfImprovements;
-  int i, j, k, sameHand, tempRank, swapIndex, randRank;
-  //Loop over possible cards to discard
-  for(i=0; i<HAND_SIZE; ++i)
-  { /*Load in a copy of the input hand this is a simple way to 
-    * avoid a nasty bug that occurs when hands have cards 
-    * that share a rank*/
-    loadCopyHand();
-    sortHand();
-    tempSuit = handSuit[i];
-    tempRank = handRank[i];
-    numOfImprovements=0;
-    swapIndex=i;
-    for(j=0; j<sampleNumber; ++j) 
-    { do{
-        sameHand=FALSE;
-        //Offset of 2 on rank because of the way the rank system is defined
-        randRank=rand()%RANK_COUNT + 2;
-        randSuit=SUIT_LIST[rand()%SUIT_COUNT];
-        handRank[swapIndex]=randRank;
-        handSuit[swapIndex]=randSuit;
-        if((randRank==tempRank)&&(randSuit==tempSuit))
-        { sameHand=TRUE;
-        }
-      }while(repeatCards()==TRUE||sameHand==TRUE);
-      sortHand();
-      //After sorting we lose track of the card that got swapped
-      for(k=0;k<HAND_SIZE;++k)
-      { if((randRank==handRank[k]) && (randSuit==handSuit[k])) 
-        { swapIndex=k;
-          break;
-        } 
-      }
-      if(isBetterHand()==TRUE){
-        ++numOfImprovements;
-        //printHand();
+uint64_t statsClock(void)
+{ struct timespec moment;
+  if(showStats==FALSE) return 0;
+  clock_gettime(CLOCK_MONOTONIC,&moment);
+  return (uint64_t)moment.tv_sec*1000000000+moment.tv_nsec;
+}
+/************************************************************************
+* recordLineStats prints the --stats line of one input line and adds it
+* to the totals. marks[] holds the clock at the start of every phase
+* and marks[PHASE_COUNT] the clock at the end of the line. The counts of
+* the line are what the counters of the context moved by.
+*
+* No returns, takes the context, the line's readLine status and marks
+**************************************************************************/
+void recordLineStats(const PokerContext *context, int lineStatus, const uint64_t marks[])
+{ PokerStats stats;
+  uint64_t phaseTime[PHASE_COUNT];
+  int phase, category=0;
+  pokerGetContextStats(context,&stats);
+  ++statsLines;
+  for(phase=0; phase<PHASE_COUNT; ++phase)
+  { phaseTime[phase]=marks[phase+1]-marks[phase];
+    statsPhaseTime[phase]+=phaseTime[phase];
+  }
+  if(lineStatus==1)
+  { category=result.category;
+    ++statsCategoryLines[category];
+    statsCategoryTime[category]+=phaseTime[PROBABILITY_PHASE];
+  }
+  fprintf(stderr,"stats: line %llu %s parse %llu ns, classify %llu ns, "
+                 "probabilities %llu ns, output %llu ns, %llu evaluations, cache %s\n",
+          (unsigned long long)statsLines,(lineStatus==1) ? CATEGORY_NAMES[category] : "Error",
+          (unsigned long long)phaseTime[PARSE_PHASE],(unsigned long long)phaseTime[CLASSIFY_PHASE],
+          (unsigned long long)phaseTime[PROBABILITY_PHASE],(unsigned long long)phaseTime[OUTPUT_PHASE],
+          (unsigned long long)(stats.evaluations-lastStats.evaluations),
+          (stats.cacheHits!=lastStats.cacheHits) ? "hit"
+          : (stats.cacheMisses!=lastStats.cacheMisses) ? "miss" : "-");
+  lastStats=stats;
+}
+/************************************************************************
+* printStats reports the totals of the run on standard error, so the
+* results on standard output are not disturbed: time per phase, where
+* the probability time went by major rank, evaluations, the cache and
+* the evaluator kernel.
+**************************************************************************/
+void printStats(const PokerContext *context)
+{ PokerStats stats;
+  int phase, category;
+  uint64_t lookups;
+  pokerGetContextStats(context,&stats);
+  lookups=stats.cacheHits+stats.cacheMisses;
+  fprintf(stderr,"total: %llu lines, %llu evaluations\n",
+          (unsigned long long)statsLines,(unsigned long long)stats.evaluations);
+  for(phase=0; phase<PHASE_COUNT && statsLines>0; ++phase)
+  { fprintf(stderr,"phase: %s %.3f ms, %.0f ns per line\n",PHASE_NAMES[phase],
+            statsPhaseTime[phase]/1e6,(double)statsPhaseTime[phase]/statsLines);
+  }
+  for(category=POKER_HIGH_CARD; category<=POKER_STRAIGHT_FLUSH; ++category)
+  { if(statsCategoryLines[category]==0) continue;
+    fprintf(stderr,"category: %s %llu lines, %.0f ns per line in probabilities\n",
+            CATEGORY_NAMES[category],(unsigned long long)statsCategoryLines[category],
+            (double)statsCategoryTime[category]/statsCategoryLines[category]);
+  }
+  fprintf(stderr,"cache: %llu hits, %llu misses, %.1f%% hit rate, %d entries of %d, %llu evictions\n",
+          (unsigned long long)stats.cacheHits,(unsigned long long)stats.cacheMisses,
+          (lookups>0) ? 100.0*stats.cacheHits/lookups : 0.0,
+          stats.cacheUsed,stats.cacheCapacity,(unsigned long long)stats.cacheEvictions);
+  fprintf(stderr,"kernel: %s\n",pokerKernelName());
+}
+/********************************************************************
+* Test function that prints hand in its current state
+*
+********************************************************************/
+
+void printHand(void)
+{ int i;
+  for(i=0; i<hand.cardCount; ++i)
+  { printf("%d%c ",hand.cards[i]%RANK_COUNT+2,SUIT_LIST[hand.cards[i]/RANK_COUNT]);
+  }
+  printf("\n");
+}
+/********************************************************************
+* runServer answers hands sent to listenAddress until SIGINT or
+* SIGTERM, so the tables and the context are set up once for many
+* jobs. One poll loop serves every connection. Each line read goes
+* into the batch being gathered, and the batch is evaluated with one
+* pokerEvaluateHands call once it holds batchSize hands or its first
+* hand has waited maxLatency microseconds, whichever comes first.
+* Replies are queued per connection and written as the socket takes
+* them, so a client can send many lines without waiting for any reply.
+* Every reply is exactly the line stdin mode would print, in the order
+* the client sent its lines.
+*
+* Returns the exit status of the program
+********************************************************************/
+int runServer(PokerContext *context)
+{ struct pollfd polls[MAX_CLIENTS+1];
+  struct sigaction action;
+  struct timespec wait;
+  int slots[MAX_CLIENTS+1];
+  int listener, pollCount, i, slot;
+  uint64_t now, deadline;
+  Client *client;
+  if((listener=openListener(listenAddress))<0) return 1;
+  for(slot=0; slot<MAX_CLIENTS; ++slot) clients[slot].socket=-1;
+  //No SA_RESTART, a signal has to break ppoll so the loop sees it
+  memset(&action,0,sizeof(action));
+  action.sa_handler=stopServer;
+  sigaction(SIGINT,&action,NULL);
+  sigaction(SIGTERM,&action,NULL);
+  while(serverStopping==0)
+  { pollCount=0;
+    if(clientCount<MAX_CLIENTS)
+    { polls[pollCount].fd=listener;
+      polls[pollCount].events=POLLIN;
+      slots[pollCount++]=-1;
+    }
+    for(slot=0; slot<MAX_CLIENTS; ++slot)
+    { client=&clients[slot];
+      if(client->socket<0 || client->broken==TRUE) continue;
+      polls[pollCount].events=0;
+      //A client that does not read its replies is not read from either
+      if(client->closing==FALSE && client->outputLength-client->outputStart<CLIENT_OUTPUT_LIMIT)
+      { polls[pollCount].events|=POLLIN;
       }
+      if(client->outputLength>client->outputStart) polls[pollCount].events|=POLLOUT;
+      if(polls[pollCount].events==0) continue;
+      polls[pollCount].fd=client->socket;
+      slots[pollCount++]=slot;
     }
-    //printf("\n");
-    //Locate where this card was in the  original arrays
-    for(j=0; j<HAND_SIZE; ++j)
-    { if((tempSuit==copyHandSuit[j]) && (tempRank==copyHandRank[j]))
-      { probabilities[j] = 100*((float)numOfImprovements/sampleNumber);
-        break;
+    if(batchCount>0)
+    { now=serverClock();
+      deadline=batchStart+maxLatency;
+      wait.tv_sec=(deadline>now) ? (deadline-now)/1000000 : 0;
+      wait.tv_nsec=(deadline>now) ? (deadline-now)%1000000*1000 : 0;
+    }
+    if(ppoll(polls,pollCount,(batchCount>0) ? &wait : NULL,NULL)<0)
+    { if(errno==EINTR) continue;
+      perror("poll");
+      break;
+    }
+    for(i=0; i<pollCount; ++i)
+    { if(polls[i].revents==0) continue;
+      if(slots[i]<0) acceptClients(listener);
+      else
+      { if(polls[i].revents & (POLLIN|POLLHUP|POLLERR)) readClient(context,slots[i]);
+        if(polls[i].revents & POLLOUT) writeClient(slots[i]);
       }
     }
+    if(batchCount>0 && serverClock()>=batchStart+maxLatency) flushBatch(context);
+    reapClients();
+  }
+  //Answer what has been read, one last try at writing it out
+  if(batchCount>0) flushBatch(context);
+  for(slot=0; slot<MAX_CLIENTS; ++slot)
+  { if(clients[slot].socket<0) continue;
+    clients[slot].closing=TRUE;
+    clients[slot].broken=TRUE;
   }
+  reapClients();
+  close(listener);
+  if(listenPath!=NULL) unlink(listenPath);
+  if(showStats==TRUE)
+  { fprintf(stderr,"server: %llu batches, %.1f hands per batch\n",(unsigned long long)statsBatches,
+            (statsBatches>0) ? (double)statsLines/statsBatches : 0.0);
+    printStats(context);
+  }
+  return 0;
+}
+/********************************************************************
+* stopServer is the SIGINT and SIGTERM handler of runServer
+********************************************************************/
+void stopServer(int signal)
+{ (void)signal;
+  serverStopping=1;
 }
 /********************************************************************
-* Sorts current hand according to rank from lowest to highest and 
-* suit according to an arbitrarily chosen suit order. This will make
-* the process of determining the rank of hands much simpler
-*
-* No returns no parameters                                 
-* Currently bubble sorting. If a swap takes place in a sweep
-* of the array, swapDetector is set to 1 to alert the program that 
-* it needs to sweep over the array again. Bubble sort is actually
-* quite appropriate in this context since most of the time it is
-* sorting small nearly-sorted hands.       
-********************************************************************/
-void sortHand(void)
-{ int swapDetector=TRUE, tempRank, tempSuit, i;
-  //1st sort by rank
-  while(swapDetector==TRUE)
-  { swapDetector=FALSE;
-    for(i=0; i<HAND_SIZE-1; ++i)
-    { 
-      if(handRank[i]>handRank[i+1])
-      { tempRank = handRank[i];
-        handRank[i] = handRank[i+1];
-        handRank[i+1] = tempRank;
-        //Make sure suits stick with ranks
-        tempSuit = handSuit[i];
-        handSuit[i]=handSuit[i+1];
-        handSuit[i+1] = tempSuit;
-        swapDetector = TRUE;
-      }	
-    }
-    --i;
-  }
-}
-/********************************************************************
-* getHandRank modifies the global pokerHandID variable for Major
-* and minor ranks. Major rank is most critical and gets an integer 
-* from 1-9. Better hands have higher integer values:
-* 1 ~ High card (Junk) : Minor rank is high card
-* 2 ~ One pair         : Minor rank is pair rank
-* 3 ~ Two pair         : Minor ranks are both pair ranks
-* 4 ~ Three of a kind  : Minor rank is 3 of a kind rank
-* 5 ~ Straight         : Minor rank is high card
-* 6 ~ Flush            : Minor rank is high card
-* 7 ~ Full house       : Minor rank is three of a kind rank
-* 8 ~ Four of a kind   : Minor rank is four of a kind rank
-* 9 ~ Straight Flush   : Minor rank is high card
-*
-* No parameters, no returns
-********************************************************************/
-void getHandRank(void)
-{ int straightMinorRank, flushMinorRank, tempMinorRank;
-  //Default is that two pair digit is zero, unless the hand is a two pair
-  //Apologizing now for code golf
-  pokerHandID[LOW_PAIR_DIGIT]=0;
-  straightMinorRank = isStraight();
-  flushMinorRank = isFlush();
-  if((flushMinorRank!=0) && (straightMinorRank!=0)) 
-  { pokerHandID[MAJOR_RANK_DIGIT]=STRAIGHT_FLUSH;
-    pokerHandID[MINOR_RANK_DIGIT]=straightMinorRank;
-  }
-  else if((tempMinorRank=isXOfAKind(4))!=0) 
-  { pokerHandID[MAJOR_RANK_DIGIT]=FOUR_OF_A_KIND;
-    pokerHandID[MINOR_RANK_DIGIT]=tempMinorRank;
-  }
-  else if((tempMinorRank=isFullHouse())!=0)
-  { pokerHandID[MAJOR_RANK_DIGIT]=FULL_HOUSE;
-    pokerHandID[MINOR_RANK_DIGIT]=tempMinorRank;
-  }
-  else if(flushMinorRank!=0)        
-  { pokerHandID[MAJOR_RANK_DIGIT]=FLUSH;
-    pokerHandID[MINOR_RANK_DIGIT]=flushMinorRank;
-  }
-  else if(straightMinorRank!=0)    
-  { pokerHandID[MAJOR_RANK_DIGIT]=STRAIGHT;
-    pokerHandID[MINOR_RANK_DIGIT]=straightMinorRank;
-  }
-  else if((tempMinorRank=isXOfAKind(3))!=0)
-  { pokerHandID[MAJOR_RANK_DIGIT]=THREE_OF_A_KIND;
-    pokerHandID[MINOR_RANK_DIGIT]=tempMinorRank;
-  }
-  else if((tempMinorRank=isTwoPair())!=0)
-  { pokerHandID[MAJOR_RANK_DIGIT]=TWO_PAIR;
-    pokerHandID[MINOR_RANK_DIGIT]=tempMinorRank;
-    pokerHandID[LOW_PAIR_DIGIT]=isXOfAKind(2);
-  }
-  else if((tempMinorRank=isXOfAKind(2))!=0) 
-  { pokerHandID[MAJOR_RANK_DIGIT]=ONE_PAIR;
-    pokerHandID[MINOR_RANK_DIGIT]=tempMinorRank;
+* openListener makes the listening socket of --listen. An address
+* with a / in it is the path of a Unix socket, anything else is
+* [HOST:]PORT for TCP, HOST being a name, an IPv4 address or an IPv6
+* address in brackets. A Unix socket left behind by an earlier run is
+* replaced, any other file at the path is not.
+*
+* Returns the non-blocking socket, or -1 after printing why not
+********************************************************************/
+int openListener(const char *address)
+{ struct sockaddr_un local;
+  struct addrinfo hints, *found, *entry;
+  struct stat status;
+  char host[256];
+  const char *port;
+  size_t hostLength;
+  int listener=-1, reuse=1, error;
+  if(strchr(address,'/')!=NULL)
+  { if(strlen(address)>=sizeof(local.sun_path))
+    { fprintf(stderr,"%s: socket path too long\n",address);
+      return -1;
+    }
+    memset(&local,0,sizeof(local));
+    local.sun_family=AF_UNIX;
+    strcpy(local.sun_path,address);
+    if(stat(address,&status)==0 && S_ISSOCK(status.st_mode)) unlink(address);
+    if((listener=socket(AF_UNIX,SOCK_STREAM,0))<0
+       || bind(listener,(struct sockaddr *)&local,sizeof(local))!=0)
+    { perror(address);
+      if(listener>=0) close(listener);
+      return -1;
+    }
+    listenPath=address;
   }
   else
-  { pokerHandID[MAJOR_RANK_DIGIT]=HIGH_CARD;
-    pokerHandID[MINOR_RANK_DIGIT]=highCard();
+  { port=strrchr(address,':');
+    hostLength=(port!=NULL) ? (size_t)(port-address) : 0;
+    port=(port!=NULL) ? port+1 : address;
+    if(hostLength>=2 && address[0]=='[' && address[hostLength-1]==']')
+    { ++address;
+      hostLength-=2;
+    }
+    if(hostLength>=sizeof(host))
+    { fprintf(stderr,"%s: host name too long\n",address);
+      return -1;
+    }
+    memcpy(host,address,hostLength);
+    host[hostLength]='\0';
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family=AF_UNSPEC;
+    hints.ai_socktype=SOCK_STREAM;
+    hints.ai_flags=AI_PASSIVE;
+    if((error=getaddrinfo((hostLength>0) ? host : NULL,port,&hints,&found))!=0)
+    { fprintf(stderr,"%s: %s\n",listenAddress,gai_strerror(error));
+      return -1;
+    }
+    for(entry=found; entry!=NULL; entry=entry->ai_next)
+    { if((listener=socket(entry->ai_family,entry->ai_socktype,entry->ai_protocol))<0) continue;
+      setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,&reuse,sizeof(reuse));
+      if(bind(listener,entry->ai_addr,entry->ai_addrlen)==0) break;
+      close(listener);
+      listener=-1;
+    }
+    freeaddrinfo(found);
+    if(listener<0)
+    { fprintf(stderr,"%s: could not bind\n",listenAddress);
+      return -1;
+    }
   }
- 
+  if(listen(listener,LISTEN_BACKLOG)!=0
+     || fcntl(listener,F_SETFL,fcntl(listener,F_GETFL)|O_NONBLOCK)!=0)
+  { perror(listenAddress);
+    close(listener);
+    return -1;
+  }
+  return listener;
 }
 /********************************************************************
-* isBetterHand compares the major and minor ranks stored in 
-* pokerHandId to that of handRank[] and handSuit[]. It implements 
-* a switch so that cases that are ruled out for a better hand are not
-* checked. For example, if we know the original hand was a straight,
-* we need not check if the new hand is a pair, that would not yield 
-* a better hand.
-*
-* Returns TRUE if a better hand was drawn, FALSE otherwise
-* No parameters
+* acceptClients takes every waiting connection there is a free slot
+* for. Replies are small and latency is the point, so Nagle is off
+* on TCP connections.
 ********************************************************************/
-int isBetterHand (void)
-{ int majorRank = pokerHandID[MAJOR_RANK_DIGIT];
-  int minorRank = pokerHandID[MINOR_RANK_DIGIT];
-  int tempMinor, straightMinorRank=0, flushMinorRank=0,  betterHandDetected=FALSE;
-
-  switch (majorRank)
-  { case HIGH_CARD:
-      //printf("entered high card switch\n");
-      if(highCard()>minorRank)
-      { betterHandDetected=TRUE;
-        break;
-      }
-    case ONE_PAIR:
-      //printf("entered one pair switch\n");
-      tempMinor = isXOfAKind(2);
-      //Check if new hand is One Pair
-      if(tempMinor!=0)
-      { if(ONE_PAIR>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else
-        { if(tempMinor>minorRank)
-          { betterHandDetected=TRUE;
-            break; 
-          }
-        }
-      }
-    case TWO_PAIR:
-      //printf("Entered two pair switch\n");
-      tempMinor = isTwoPair();
-      if(tempMinor!=0)
-      { if(TWO_PAIR>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else
-        { if(tempMinor>minorRank)
-          { betterHandDetected=TRUE;
-            break;
-          }
-          //ONLY REACHED IF 1ST PAIR MATCHES
-          else if(tempMinor==minorRank)
-          { //Looks at 1st pair ranks
-            if(isXOfAKind(2)>pokerHandID[LOW_PAIR_DIGIT])
-            { betterHandDetected=TRUE;
-              break;
-            }
-          }
-        }
-      }
-    case THREE_OF_A_KIND:
-      //printf("entered three of a kind switch\n");
-      tempMinor = isXOfAKind(3);
-      if(tempMinor!=0)
-      { if(THREE_OF_A_KIND>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else if(tempMinor>minorRank)
-        { betterHandDetected=TRUE;
-          break; 
-        }
-      }
-    case STRAIGHT:
-      straightMinorRank = isStraight();
-      //printf("entered straight switch\n");
-      if(straightMinorRank!=0)
-      { if(STRAIGHT>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else if(straightMinorRank>minorRank)
-        { betterHandDetected=TRUE;
-          break; 
-        }
-      }
-    case FLUSH:
-      //printf("entered flush switch\n");
-      flushMinorRank = isFlush();
-      if(flushMinorRank!=0) 
-      { if(FLUSH>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else if(flushMinorRank>minorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-      }
-    case FULL_HOUSE:
-      //printf("entered full house switch\n");
-      tempMinor = isFullHouse();
-      if(tempMinor!=0)
-      { if(FULL_HOUSE>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else if(tempMinor>minorRank)
-        { betterHandDetected=TRUE;
-          break; 
-        }
-      } 
-    case FOUR_OF_A_KIND:
-      tempMinor = isXOfAKind(4);
-      //printf("entered four of a kind switch\n");
-      if(tempMinor!=0)
-      { if(FOUR_OF_A_KIND>majorRank)
-        { betterHandDetected=TRUE;
-          break;
-        }
-        else if(tempMinor>minorRank)
-        { betterHandDetected=TRUE;
-          break; 
-        }
-      }
-    case STRAIGHT_FLUSH:
-      //printf("entered straight flush switch\n");
-      //in the case that isStraight and isFlush have not been called
-      if(straightMinorRank==0)
-      { straightMinorRank=isStraight();
-      }
-      if(flushMinorRank==0)
-      { flushMinorRank=isFlush();
-      }
-      if(straightMinorRank!=0 && flushMinorRank!=0)
-      { if(majorRank==STRAIGHT_FLUSH)
-        { if(straightMinorRank>minorRank)
-            { betterHandDetected=TRUE;
-              break;
-            }
-        }
-        else
-        { betterHandDetected=TRUE;
-          break;
-        }
-      }
+void acceptClients(int listener)
+{ int connection, slot=0, noDelay=1;
+  while(clientCount<MAX_CLIENTS)
+  { if((connection=accept4(listener,NULL,NULL,SOCK_NONBLOCK|SOCK_CLOEXEC))<0) return;
+    setsockopt(connection,IPPROTO_TCP,TCP_NODELAY,&noDelay,sizeof(noDelay));
+    for(; clients[slot].socket>=0; ++slot);
+    memset(&clients[slot],0,sizeof(Client));
+    clients[slot].socket=connection;
+    ++clientCount;
   }
-  return betterHandDetected;
 }
-
 /********************************************************************
-* HERE BEGINS THE SLEW OF "isSomething" FUNCTIONS.
+* readClient reads what a connection has sent and queues every whole
+* line of it. A line that overflows the input buffer is answered as
+* an Error with its start echoed, and the rest of it is dropped. At
+* end of input a last line without a newline is still read, and the
+* connection closes once all its replies are out.
 ********************************************************************/
-
+void readClient(PokerContext *context, int slot)
+{ Client *client=&clients[slot];
+  char *line, *newline, *end;
+  ssize_t count;
+  count=recv(client->socket,client->input+client->inputLength,
+             CLIENT_INPUT_SIZE-client->inputLength,0);
+  if(count<0)
+  { if(errno!=EINTR && errno!=EAGAIN && errno!=EWOULDBLOCK) client->closing=client->broken=TRUE;
+    return;
+  }
+  client->inputLength+=count;
+  line=client->input;
+  end=client->input+client->inputLength;
+  while((newline=memchr(line,'\n',end-line))!=NULL)
+  { if(client->discarding==FALSE) queueRequest(context,slot,line,newline-line,FALSE);
+    client->discarding=FALSE;
+    line=newline+1;
+  }
+  client->inputLength=end-line;
+  memmove(client->input,line,client->inputLength);
+  if(count==0)
+  { if(client->inputLength>0 && client->discarding==FALSE)
+    { queueRequest(context,slot,client->input,client->inputLength,FALSE);
+    }
+    client->inputLength=0;
+    client->closing=TRUE;
+  }
+  else if(client->inputLength==CLIENT_INPUT_SIZE)
+  { if(client->discarding==FALSE)
+    { queueRequest(context,slot,client->input,client->inputLength,TRUE);
+    }
+    client->inputLength=0;
+    client->discarding=TRUE;
+  }
+}
 /********************************************************************
-* isFlush determines whether or not all the suits of a hand match
-* 
-* Returns a the value of the minor rank, in this case we will use the
-* No paramters
+* queueRequest adds one line to the batch, evaluating the batch as
+* soon as it is full. A line that is not a hand is still queued with
+* its parse status, so its Error reply keeps its place.
+*
+* No returns, takes the line, its length and TRUE if it overflowed
+********************************************************************/
+void queueRequest(PokerContext *context, int slot, const char *line, size_t length,
+                  int overflow)
+{ Request *request=&batchRequests[batchCount];
+  PokerHand *parsed=&batchHands[batchCount];
+  uint64_t start=statsClock();
+  if(batchCount==0) batchStart=serverClock();
+  request->client=slot;
+  request->echoLength=MIN(length,REQUEST_ECHO_SIZE);
+  memcpy(request->echo,line,request->echoLength);
+  batchStatus[batchCount]=(overflow==TRUE) ? 0 : parseHand(line,length,parsed);
+  ++clients[slot].pending;
+  statsPhaseTime[PARSE_PHASE]+=statsClock()-start;
+  if(++batchCount==batchSize) flushBatch(context);
+}
+/********************************************************************
+* flushBatch evaluates the batch with one pokerEvaluateHands call,
+* queues the reply of every line to its connection and starts writing
+* them. With --stats it prints one line per batch: its size, how long
+* its first hand waited and the time spent evaluating it.
+********************************************************************/
+void flushBatch(PokerContext *context)
+{ char answer[ANSWER_SIZE];
+  uint64_t evaluateStart=serverClock(), evaluateEnd, outputEnd;
+  int i, slot;
+  evaluateParsed(context,batchHands,batchStatus,batchCount,batchResults);
+  evaluateEnd=serverClock();
+  for(i=0; i<batchCount; ++i)
+  { Client *client=&clients[batchRequests[i].client];
+    --client->pending;
+    if(client->broken==TRUE) continue;
+    queueReply(client,batchRequests[i].echo,batchRequests[i].echoLength);
+    queueReply(client," >>>",4);
+    queueReply(client,answer,formatAnswer(answer,batchStatus[i],&batchResults[i]));
+    queueReply(client,"\n",1);
+    if(batchStatus[i]==1 && batchResults[i].status==TRUE)
+    { ++statsCategoryLines[batchResults[i].category];
+      statsCategoryTime[batchResults[i].category]+=(evaluateEnd-evaluateStart)*1000/batchCount;
+    }
+  }
+  for(slot=0; slot<MAX_CLIENTS; ++slot)
+  { if(clients[slot].socket>=0 && clients[slot].outputLength>0) writeClient(slot);
+  }
+  outputEnd=serverClock();
+  statsLines+=batchCount;
+  ++statsBatches;
+  statsPhaseTime[PROBABILITY_PHASE]+=(evaluateEnd-evaluateStart)*1000;
+  statsPhaseTime[OUTPUT_PHASE]+=(outputEnd-evaluateEnd)*1000;
+  if(showStats==TRUE)
+  { fprintf(stderr,"stats: batch %llu %d hands, waited %llu us, evaluated in %llu us\n",
+            (unsigned long long)statsBatches,batchCount,
+            (unsigned long long)(evaluateStart-batchStart),
+            (unsigned long long)(evaluateEnd-evaluateStart));
+  }
+  batchCount=0;
+}
+/********************************************************************
+* queueReply appends to the replies waiting for a connection, moving
+* the unwritten part to the front or growing the buffer when it is
+* full. A connection whose buffer cannot grow is dropped.
 ********************************************************************/
-int isFlush(void)
-{ int i=0, flushSum=0; //default false
-  char flushSuit=handSuit[i];
-  for(i=1; i<HAND_SIZE; ++i)
-  { if(flushSuit!=handSuit[i])
-    { return FALSE;
+void queueReply(Client *client, const char *data, size_t length)
+{ char *grown;
+  size_t capacity;
+  if(client->broken==TRUE) return;
+  if(client->outputLength+length>client->outputCapacity && client->outputStart>0)
+  { client->outputLength-=client->outputStart;
+    memmove(client->output,client->output+client->outputStart,client->outputLength);
+    client->outputStart=0;
+  }
+  if(client->outputLength+length>client->outputCapacity)
+  { capacity=MAX(client->outputCapacity,ANSWER_SIZE);
+    while(capacity<client->outputLength+length) capacity*=2;
+    if((grown=realloc(client->output,capacity))==NULL)
+    { client->closing=client->broken=TRUE;
+      return;
     }
-  } 
-  if(i==HAND_SIZE)
-  { for(i=0;i<HAND_SIZE;++i)
-    { flushSum+=handRank[i];
+    client->output=grown;
+    client->outputCapacity=capacity;
+  }
+  memcpy(client->output+client->outputLength,data,length);
+  client->outputLength+=length;
+}
+/********************************************************************
+* writeClient writes as many waiting replies as the socket takes
+* without blocking, the rest waits for the next POLLOUT
+********************************************************************/
+void writeClient(int slot)
+{ Client *client=&clients[slot];
+  ssize_t count;
+  while(client->broken==FALSE && client->outputStart<client->outputLength)
+  { count=send(client->socket,client->output+client->outputStart,
+               client->outputLength-client->outputStart,MSG_NOSIGNAL);
+    if(count<0 && errno==EINTR) continue;
+    if(count<0 && (errno==EAGAIN || errno==EWOULDBLOCK)) return;
+    if(count<=0)
+    { client->broken=TRUE;
+      return;
     }
+    client->outputStart+=count;
   }
-  return flushSum;
+  client->outputStart=client->outputLength=0;
 }
 /********************************************************************
-* isStraight determines whether or not the hand is of rank straight.
-* A straight occurs when the ranks of your cards can be arranged in
-* a contiguous order. EX: 8 9 10 J Q / 8 9 10 11 12
-* There is a special straight that is the sequence 2 3 4 5 A.
+* reapClients closes every connection that is done: closing, with no
+* line left in the batch and every reply written, or broken. A slot
+* with lines in the batch is never reused, so no reply goes astray.
+********************************************************************/
+void reapClients(void)
+{ Client *client;
+  int slot;
+  for(slot=0; slot<MAX_CLIENTS; ++slot)
+  { client=&clients[slot];
+    if(client->socket<0 || client->closing==FALSE || client->pending>0) continue;
+    if(client->broken==FALSE && client->outputLength>client->outputStart) continue;
+    close(client->socket);
+    free(client->output);
+    memset(client,0,sizeof(Client));
+    client->socket=-1;
+    --clientCount;
+  }
+}
+/********************************************************************
+* serverClock reads the monotonic clock the batch deadlines run on
 *
-* Returns high card in straight if it is a straight, otherwise 0
-* No parameters.
+* Returns microseconds from an arbitrary start
 ********************************************************************/
-int isStraight(void)
-{ int i,j, highCard=0;
-  int specialStraight[HAND_SIZE]= {2,3,4,5,14};
-    for(i=0; i<HAND_SIZE; ++i)
-    { if(handRank[i]!=specialStraight[i])
-      { break;
-      }
-    }
-  for(j=0; j<HAND_SIZE-1; ++j)
-  { if(handRank[j]!=handRank[j+1]-1)
-    { break;
+uint64_t serverClock(void)
+{ struct timespec moment;
+  clock_gettime(CLOCK_MONOTONIC,&moment);
+  return (uint64_t)moment.tv_sec*1000000+moment.tv_nsec/1000;
+}
+/********************************************************************
+* runBinary answers binary records on standard input instead of text
+* lines. The input is a BinaryHeader of format BINARY_CARDS, records
+* of HAND_SIZE card bytes POKER_CARD(rank index, suit index) in hand
+* order, or BINARY_MASK, records of one 64 bit card mask. The output is a
+* BinaryHeader of binaryFormat and one FloatRecord or FixedRecord per
+* input record. A file is mapped and read in place, anything else
+* goes through inputBuffer. Records are handed to the engine
+* MAX_BATCH_SIZE at a time.
+*
+* Returns the exit status, 0 when every record was answered
+********************************************************************/
+int runBinary(PokerContext *context)
+{ BinaryHeader header;
+  const uint8_t *block;
+  size_t length, recordSize;
+  int i, count, format;
+  mapInput();
+  if(nextBinaryBlock(&block,sizeof(header),sizeof(header))<sizeof(header))
+  { fprintf(stderr,"binary input has no header\n");
+    return 1;
+  }
+  memcpy(&header,block,sizeof(header));
+  recordSize=(header.format==BINARY_CARDS) ? HAND_SIZE : sizeof(uint64_t);
+  if(memcmp(header.magic,BINARY_MAGIC,sizeof(header.magic))!=0
+     || header.version!=BINARY_VERSION || header.recordSize!=recordSize
+     || (header.format!=BINARY_CARDS && header.format!=BINARY_MASK))
+  { fprintf(stderr,"binary input header is not version %d of a format this build reads\n",
+            BINARY_VERSION);
+    return 1;
+  }
+  format=header.format;
+  memcpy(header.magic,BINARY_MAGIC,sizeof(header.magic));
+  header.format=binaryFormat;
+  header.mode=options.mode;
+  header.recordSize=(binaryFormat==BINARY_FLOAT) ? sizeof(FloatRecord) : sizeof(FixedRecord);
+  writeOutput((const char *)&header,sizeof(header));
+  while((length=nextBinaryBlock(&block,recordSize,MAX_BATCH_SIZE*recordSize))>0)
+  { count=(int)(length/recordSize);
+    for(i=0; i<count; ++i)
+    { batchStatus[i]=decodeRecord(block+i*recordSize,format,&batchHands[i]);
     }
+    statsLines+=count;
+    evaluateParsed(context,batchHands,batchStatus,count,batchResults);
+    for(i=0; i<count; ++i) writeRecord(batchStatus[i],&batchResults[i]);
+  }
+  flushOutput();
+  if((mappedInput!=NULL) ? mappedOffset<mappedLength : inputStart<inputEnd)
+  { fprintf(stderr,"binary input ends inside a record\n");
+    return 1;
+  }
+  return 0;
+}
+/********************************************************************
+* mapInput maps standard input into memory when it is a non-empty
+* regular file, so runBinary reads the records where they lie. Pipes,
+* sockets and failed maps are left to read().
+*
+* No returns no parameters, sets mappedInput and mappedLength
+********************************************************************/
+void mapInput(void)
+{ struct stat status;
+  void *map;
+  if(fstat(STDIN_FILENO,&status)!=0 || S_ISREG(status.st_mode)==0 || status.st_size==0) return;
+  map=mmap(NULL,(size_t)status.st_size,PROT_READ,MAP_PRIVATE,STDIN_FILENO,0);
+  if(map==MAP_FAILED) return;
+  madvise(map,(size_t)status.st_size,MADV_SEQUENTIAL);
+  mappedInput=map;
+  mappedLength=(size_t)status.st_size;
+  mappedOffset=0;
+}
+/********************************************************************
+* nextBinaryBlock hands out the next whole records of binary input,
+* at most limit bytes, from the mapped file or from inputBuffer. A
+* block out of inputBuffer is only good until the next call.
+*
+* Returns the bytes in *block, a multiple of recordSize, 0 once no
+* whole record is left
+********************************************************************/
+size_t nextBinaryBlock(const uint8_t **block, size_t recordSize, size_t limit)
+{ size_t length;
+  if(mappedInput!=NULL)
+  { length=MIN(mappedLength-mappedOffset,limit);
+    length-=length%recordSize;
+    *block=mappedInput+mappedOffset;
+    mappedOffset+=length;
+    return length;
+  }
+  while(inputEnd-inputStart<recordSize && inputAtEOF==FALSE) fillInput();
+  length=MIN(inputEnd-inputStart,limit);
+  length-=length%recordSize;
+  *block=(const uint8_t *)inputBuffer+inputStart;
+  inputStart+=length;
+  return length;
+}
+/********************************************************************
+* decodeRecord turns one binary input record into a hand. The cards of
+* a mask go in lowest bit first. Card bytes are checked by the engine
+* like the cards of any hand.
+*
+* Returns 1, or 0 for a mask that is not HAND_SIZE cards of the deck
+* Takes the record, its format and the hand to fill
+********************************************************************/
+int decodeRecord(const uint8_t *record, int format, PokerHand *decoded)
+{ uint64_t mask;
+  int i;
+  decoded->cardCount=HAND_SIZE;
+  decoded->deadMask=0;
+  if(format==BINARY_CARDS)
+  { memcpy(decoded->cards,record,HAND_SIZE);
+    return 1;
   }
-  if(j==HAND_SIZE-1) highCard=handRank[HAND_SIZE-1];
-  if(i==HAND_SIZE)   highCard=handRank[HAND_SIZE-2];
-  return highCard;
+  memcpy(&mask,record,sizeof(mask));
+  if(__builtin_popcountll(mask)!=HAND_SIZE || (mask>>DECK_SIZE)!=0) return 0;
+  for(i=0; i<HAND_SIZE; ++i, mask&=mask-1) decoded->cards[i]=__builtin_ctzll(mask);
+  return 1;
 }
 /********************************************************************
-* isXOfAKind determines whether or not X cards in the hand all
-* share a rank. When x=4 this is the 2nd highest ranking hand.
-* This algorithm will not keep looking through the hand if it has 
-* found more than HAND_SIZE-x+1 unique ranks in the hand.(efficiency)
+* writeRecord appends the output record of one result in binaryFormat,
+* all zero for a record that did not decode or a hand the engine
+* refused
 *
-* Returns the minor rank of the four of a kind if found, otherwise 0
-* Takes an integer x that corresponds to the # of matching ranks
-* desired.
+* Takes the decodeRecord status and the result
 ********************************************************************/
-int isXOfAKind(int x)
-{ int i=0, diffCounter, matchCounter, rankOfMatchingCards=0;
-  matchCounter=diffCounter=1;
-  while(diffCounter<=HAND_SIZE-x+1)
-  { if(handRank[i]==handRank[i+1]) ++matchCounter;
-    else 
-    { ++diffCounter;
-      matchCounter=1;
+void writeRecord(int recordStatus, const PokerResult *answered)
+{ FloatRecord floatRecord;
+  FixedRecord fixedRecord;
+  int i;
+  if(binaryFormat==BINARY_FLOAT)
+  { memset(&floatRecord,0,sizeof(floatRecord));
+    if(recordStatus==1 && answered->status==TRUE)
+    { floatRecord.status=1;
+      floatRecord.category=answered->category;
+      floatRecord.score=answered->score;
+      for(i=0; i<HAND_SIZE; ++i) floatRecord.probabilities[i]=answered->probabilities[i];
     }
-    if(matchCounter==x)
-    { rankOfMatchingCards=handRank[i];
-      break;
+    writeOutput((const char *)&floatRecord,sizeof(floatRecord));
+    return;
+  }
+  memset(&fixedRecord,0,sizeof(fixedRecord));
+  if(recordStatus==1 && answered->status==TRUE)
+  { fixedRecord.status=1;
+    fixedRecord.category=answered->category;
+    fixedRecord.score=answered->score;
+    for(i=0; i<HAND_SIZE; ++i)
+    { fixedRecord.probabilities[i]=(uint16_t)(answered->probabilities[i]*FIXED_POINT_SCALE+0.5f);
     }
-    ++i;
   }
-  return rankOfMatchingCards;
+  writeOutput((const char *)&fixedRecord,sizeof(fixedRecord));
 }
 /********************************************************************
-* isFullHouse determine if the hand has a 3 of a kind AND a pair, 
-* where each occurs in a unique rank. EX: 5 5 A A A
-* 
-* Returns the minor rank of the three of a kind in the full house
-* if a full house is found, otherwise 0.
+* runPipeline answers standard input like the loop in main, but on
+* workerCount threads. Main reads the lines into chunks of at most
+* CHUNK_LINES lines and CHUNK_TEXT_SIZE bytes and deals them out to
+* the workers in turn, each worker works out and formats a chunk at a
+* time with its own context, and main writes the chunks out in input
+* order. Only chunkSlots chunks are in flight, main waits for the
+* oldest before reusing its slot, so memory stays the same however
+* long the input is. A line too long for a chunk is answered by main
+* once every chunk before it is out.
 *
-* matchCounter keeps track of the numbers of repeated cards. If the
-* content of the array is 2 3 or 3 2, then we have a full house.
+* Returns the exit status, takes the context of the first worker
 ********************************************************************/
-int isFullHouse(void)
-{ int i, uniqueCards, counter[2], cardRankOfTriplet=0;
-  counter[0]=counter[1]=1;
-  uniqueCards=1;
-  i=0;
-  while(uniqueCards<3)
-  { if(handRank[i]==handRank[i+1])
-    { ++counter[uniqueCards-1]; 
-    }
-    else
-    { ++uniqueCards;
+int runPipeline(PokerContext *context)
+{ char answer[ANSWER_SIZE];
+  char *line;
+  size_t length, textLength=0;
+  uint64_t oldest=0, filled=0;
+  Chunk *chunk=NULL;
+  int found, open=FALSE;
+  if(startWorkers(context)==FALSE) return 1;
+  for(;;)
+  { found=findLine(&line,&length);
+    if(found==TRUE && length<=CHUNK_TEXT_SIZE)
+    { if(open==TRUE && textLength+length>CHUNK_TEXT_SIZE)
+      { dealChunk(filled++);
+        open=FALSE;
+      }
+      if(open==FALSE)
+      { if(filled-oldest==(uint64_t)chunkSlots) drainChunks(&oldest,oldest+1);
+        chunk=&chunks[filled%chunkSlots];
+        chunk->lineCount=0;
+        chunk->done=FALSE;
+        textLength=0;
+        open=TRUE;
+      }
+      memcpy(chunk->text+textLength,line,length);
+      textLength+=length;
+      chunk->lineEnd[chunk->lineCount]=(uint16_t)textLength;
+      chunk->lineStatus[chunk->lineCount]=parseHand(line,length,&chunk->hands[chunk->lineCount]);
+      if(++chunk->lineCount==CHUNK_LINES)
+      { dealChunk(filled++);
+        open=FALSE;
+      }
+      continue;
     }
-
-    ++i;
-    if((counter[0]==2 && counter[1]==3))
-    { cardRankOfTriplet=handRank[HAND_SIZE-1];
+    if(open==TRUE)
+    { dealChunk(filled++);
+      open=FALSE;
     }
-    else if((counter[0]==3 && counter[1]==2))
-    { cardRankOfTriplet=handRank[0];
+    drainChunks(&oldest,filled);
+    if(found==EOF) break;
+    //Every worker is idle, main may use the first context
+    if(found==TRUE)
+    { writeOutput(line,length);
+      found=parseHand(line,length,&hand);
     }
+    else found=readLine();
+    writeString(" >>>");
+    if(found==1) pokerEvaluateHands(context,&hand,1,&result);
+    writeOutput(answer,formatAnswer(answer,found,&result));
+    writeString("\n");
   }
-  return cardRankOfTriplet;
+  flushOutput();
+  stopWorkers();
+  return 0;
 }
 /********************************************************************
-* isTwoPair determines if two pairs occur in the ranks of the hand.
-* Ex: Q Q J J 2
+* startWorkers allocates the reorder buffer and starts workerCount
+* workers, the first one on context and every other one on a context
+* of its own created from options.
 *
-* Returns the card rank of the higher pair if found, and 0 otherwise
+* Returns TRUE, or FALSE after printing why the workers could not
+* all be started
 ********************************************************************/
-int isTwoPair(void)
-{ int i, uniqueCardCount, counter[3], highPairRank=0;
-  counter[0]=counter[1]=counter[2]=1;
-  uniqueCardCount=1;
-  i=0;
-  while((uniqueCardCount<4) && i<HAND_SIZE-1)
-  { if(handRank[i]==handRank[i+1])
-    { ++counter[uniqueCardCount-1]; 
+int startWorkers(PokerContext *context)
+{ int i, error=POKER_OK;
+  chunkSlots=CHUNKS_PER_WORKER*workerCount;
+  chunks=malloc(sizeof(Chunk)*chunkSlots);
+  workers=calloc(workerCount,sizeof(Worker));
+  if(chunks==NULL || workers==NULL)
+  { free(chunks);
+    free(workers);
+    printError(POKER_NO_MEMORY);
+    return FALSE;
+  }
+  for(i=0; i<workerCount && error==POKER_OK; ++i)
+  { pthread_mutex_init(&workers[i].lock,NULL);
+    if(i==0) workers[i].context=context;
+    else error=pokerCreateContext(&options,&workers[i].context);
+    if(error==POKER_OK && pthread_create(&workers[i].thread,NULL,pipelineWorker,&workers[i])!=0)
+    { error=POKER_NO_THREADS;
     }
-    else ++uniqueCardCount;
-    ++i;
+    if(error!=POKER_OK && i>0 && workers[i].context!=NULL) pokerDestroyContext(workers[i].context);
   }
-  //High pair in middle
-  if((counter[0]==2 && counter[1]==2))
-  { highPairRank = handRank[HAND_SIZE/2];
+  if(error==POKER_OK) return TRUE;
+  workerCount=i-1;
+  stopWorkers();
+  printError(error);
+  return FALSE;
+}
+/********************************************************************
+* stopWorkers tells the workers no more chunks come, joins them and
+* destroys every context but the first, which main owns
+*
+* No returns no parameters
+********************************************************************/
+void stopWorkers(void)
+{ int i;
+  pthread_mutex_lock(&pipelineLock);
+  pipelineStopping=TRUE;
+  pthread_cond_broadcast(&chunkQueued);
+  pthread_mutex_unlock(&pipelineLock);
+  for(i=0; i<workerCount; ++i)
+  { pthread_join(workers[i].thread,NULL);
+    pthread_mutex_destroy(&workers[i].lock);
+    if(i>0) pokerDestroyContext(workers[i].context);
   }
-  //highpair on end
-  else if((counter[0]==2 && counter[2]==2)||(counter[1]==2 && counter[2]==2))
-  { highPairRank = handRank[HAND_SIZE-1];
+  free(workers);
+  free(chunks);
+}
+/********************************************************************
+* dealChunk puts the slot of chunk number sequence at the back of the
+* queue of worker sequence%workerCount and wakes a worker
+*
+* Takes the chunk number
+********************************************************************/
+void dealChunk(uint64_t sequence)
+{ Worker *worker=&workers[sequence%workerCount];
+  pthread_mutex_lock(&worker->lock);
+  worker->queue[(worker->queueHead+worker->queueCount)%MAX_CHUNK_SLOTS]=(int)(sequence%chunkSlots);
+  ++worker->queueCount;
+  pthread_mutex_unlock(&worker->lock);
+  pthread_mutex_lock(&pipelineLock);
+  ++queuedChunks;
+  pthread_cond_signal(&chunkQueued);
+  pthread_mutex_unlock(&pipelineLock);
+}
+/********************************************************************
+* drainChunks writes out the chunks from *oldest up to until, in
+* order, waiting for each one to be done, and frees their slots
+*
+* No returns, takes the oldest chunk not written and where to stop
+********************************************************************/
+void drainChunks(uint64_t *oldest, uint64_t until)
+{ Chunk *chunk;
+  for(; *oldest<until; ++*oldest)
+  { chunk=&chunks[*oldest%chunkSlots];
+    pthread_mutex_lock(&pipelineLock);
+    while(chunk->done==FALSE) pthread_cond_wait(&chunkDone,&pipelineLock);
+    pthread_mutex_unlock(&pipelineLock);
+    writeOutput(chunk->output,chunk->outputLength);
   }
- 
-  return highPairRank; 
 }
 /********************************************************************
-* highCard determines the highest ranking card in the hand. This
-* will be useful for comparing the relative superiority of hands with
-* an identical rank. EX: 8 8 10 10 A  vs. 8 8 J J 3, 2nd hand wins
-* because J>10 in rank. (MINOR RANKS)
+* pipelineWorker is the loop of one worker: wait for a chunk to be
+* dealt, take one, answer it, until stopWorkers. queuedChunks is only
+* lowered by the worker that goes on to take the chunk, so a taken
+* count always has a chunk in some queue.
 *
-* Returns ranking of high card in integer mapping. 
+* Returns NULL, takes its Worker
 ********************************************************************/
-int highCard(void)
-{ int i, highCardRank=0;
-  for(i=0; i<HAND_SIZE; ++i)
-  { if(highCardRank<handRank[i])
-    { highCardRank = handRank[i];
+void *pipelineWorker(void *arg)
+{ Worker *worker=arg;
+  int slot;
+  for(;;)
+  { pthread_mutex_lock(&pipelineLock);
+    while(queuedChunks==0 && pipelineStopping==FALSE)
+    { pthread_cond_wait(&chunkQueued,&pipelineLock);
     }
+    if(queuedChunks==0)
+    { pthread_mutex_unlock(&pipelineLock);
+      return NULL;
+    }
+    --queuedChunks;
+    pthread_mutex_unlock(&pipelineLock);
+    while((slot=takeChunk((int)(worker-workers)))<0);
+    answerChunk(worker,&chunks[slot]);
+    pthread_mutex_lock(&pipelineLock);
+    chunks[slot].done=TRUE;
+    pthread_cond_broadcast(&chunkDone);
+    pthread_mutex_unlock(&pipelineLock);
   }
-  return highCardRank;
 }
 /********************************************************************
-* Test function that prints hand in its current state
+* takeChunk takes the oldest slot of worker self's own queue, or when
+* it is empty steals the newest of the next worker that has one
 *
+* Returns the slot, or -1 if every queue was empty when looked at
 ********************************************************************/
-
-void printHand(void)
-{ int i;
-  for(i=0; i<HAND_SIZE; ++i)
-  { printf("%d%c ",handRank[i],handSuit[i]);
+int takeChunk(int self)
+{ Worker *victim;
+  int i, slot=-1;
+  for(i=0; i<workerCount && slot<0; ++i)
+  { victim=&workers[(self+i)%workerCount];
+    pthread_mutex_lock(&victim->lock);
+    if(victim->queueCount>0 && i==0)
+    { slot=victim->queue[victim->queueHead];
+      victim->queueHead=(victim->queueHead+1)%MAX_CHUNK_SLOTS;
+      --victim->queueCount;
+    }
+    else if(victim->queueCount>0)
+    { slot=victim->queue[(victim->queueHead+--victim->queueCount)%MAX_CHUNK_SLOTS];
+    }
+    pthread_mutex_unlock(&victim->lock);
   }
-  printf("\n");
+  return slot;
+}
+/********************************************************************
+* answerChunk evaluates the hands of a chunk with one pokerEvaluateHands
+* call on the worker's context and writes what every line prints
+* into the chunk's output, the same bytes as the loop in main
+*
+* No returns, takes the worker and the chunk
+********************************************************************/
+void answerChunk(Worker *worker, Chunk *chunk)
+{ size_t start=0, length=0;
+  int i;
+  evaluateParsed(worker->context,chunk->hands,chunk->lineStatus,chunk->lineCount,
+                 worker->results);
+  for(i=0; i<chunk->lineCount; ++i)
+  { memcpy(chunk->output+length,chunk->text+start,chunk->lineEnd[i]-start);
+    length+=chunk->lineEnd[i]-start;
+    start=chunk->lineEnd[i];
+    memcpy(chunk->output+length," >>>",4);
+    length+=4;
+    length+=formatAnswer(chunk->output+length,chunk->lineStatus[i],&worker->results[i]);
+    chunk->output[length++]='\n';
+  }
+  chunk->outputLength=length;
 }